@@ -6,15 +6,18 @@ function main()
 	do_package
 }
 
+SOURCES="mlsBarcode.c mlsBarcodeEngine.c mlsBarcodeThread.c mlsBarcodeRing.c mlsBarcodeParam.c mlsBarcodeReconnect.c mlsBarcodeLatency.c mlsBarcodeStats.c mlsBarcodeLog.c mlsBarcodeDedup.c mlsBarcodeCapture.c ssiCodec.c"
+
 function do_compile()
 {
 	# Compile static object
-	${CC} -Wall -c mlsBarcode.c -I. -L.
-	# Archive static lib
-	${AR} -csr libstylssi.a mlsBarcode.o
+	${CC} -Wall -D_GNU_SOURCE -c ${SOURCES} -I. -L.
+	# Archive static lib, same objects as compiled
+	rm -f libstylssi.a
+	${AR} -csr libstylssi.a ${SOURCES//.c/.o}
 
 	# Compile demo
-	${CC} -o stylagps_demo_static example/barcode_demo.c -lstylssi -I. -L.
+	${CC} -o stylagps_demo_static example/barcode_demo.c -lstylssi -lpthread -I. -L.
 }
 
 function do_package()
@@ -23,131 +23,313 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/file.h>
+#include <linux/serial.h>
 
 #include "ssi.h"
 #include "mlsBarcode.h"
+#include "mlsBarcodeInternal.h"
+#include "ssiCodec.h"
 
 #define MSB_16(x)		(x >> 8)
 #define LSB_16(x)		(x & UINT8_MAX)
 
-#define TRUE				1
-#define FALSE				0
-
-#define LOCK_SCANNER_PATH	"/var/lock_scanner"
-
-#define TIMEOUT_MSEC		50
+#define ACK_TIMEOUT_MSEC	100
+#define DEFAULT_RETRY_LIMIT	2
+#define TX_BUFF_LEN			1024
+#define PARSE_BATCH_FRAMES	16
 
 #ifndef STYL_SW_VERSION
 #define STYL_SW_VERSION     "1.0"
 #endif
 
-static uint16_t CalculateChecksum(byte *pkg);
-static void PreparePkg(byte *pkg, byte opcode, byte *param, byte paramLen);
-static int IsChecksumOK(byte *pkg);
-static int IsContinue(byte *pkg);
 static char *strNAK(int code);
-static int LockScanner(int fd);
-static void UnlockScanner(void);
+static int LockScanner(int fd, const char *name);
+static void UnlockScanner(int fd);
 static int OpenTTY(char *name);
-static int ConfigTTY(int fd);
-static int ConfigSSI(int fd);
-static int WriteSSI(int fd, byte opcode, byte *param, byte paramLen);
-static int ReadSSI(int fd, byte *buff, const int timeout);
-static int CheckACK(int fd);
+static int ConfigTTY(mlsBarcodeReader *reader);
+static int SetLowLatency(int fd);
+static int SetSpeed(int fd, speed_t speed);
+static int NegotiateBaudRate(mlsBarcodeReader *reader);
+static void RestoreBaudRate(mlsBarcodeReader *reader);
+static int GetBaudCode(unsigned int baudRate, speed_t *speed, byte *code);
+static int ConfigSSI(mlsBarcodeReader *reader);
+static int RequestParams(mlsBarcodeReader *reader, const mlsBarcodeParam *profile, unsigned int count,
+		mlsBarcodeParam *current);
+static unsigned int DiffParams(const mlsBarcodeParam *profile, unsigned int count,
+		const mlsBarcodeParam *current, int currentCount, mlsBarcodeParam *changes);
+static int WriteSSI(mlsBarcodeReader *reader, byte opcode, byte *param, byte paramLen);
+static int WriteTx(mlsBarcodeReader *reader, const byte *buff, int len, unsigned int frames);
+static int ReadSSI(mlsBarcodeReader *reader, const int wanted, const int timeoutMs);
+static unsigned int ReadData(mlsBarcodeReader *reader, char *buff, const int buffLength, const int timeoutMs);
+static int ReadInput(mlsBarcodeReader *reader);
+static int WaitInput(int fd, const int timeoutMs);
+static int CheckACK(mlsBarcodeReader *reader);
+static int SendCommand(mlsBarcodeReader *reader, byte opcode, byte *param, byte paramLen);
+static int SendBatch(mlsBarcodeReader *reader, mlsBarcodeCommand *commands, unsigned int count);
+static int Retransmit(mlsBarcodeReader *reader, byte *pkg, int ret, byte cause);
+static void CopyCommandPkg(byte *pkg, byte opcode, const byte *param, byte paramLen);
+static int IsDuplicate(mlsBarcodeReader *reader, const byte *pkg);
 static void PrintError(int ret);
-static int ExtractBarcode(char *buff, byte *pkg, const int buffLength);
 static void DisplayPkg(byte *pkg);
+static const byte *GetCommandPkg(byte opcode);
+static int ParseInput(mlsBarcodeReader *reader);
+static int HandlePackage(mlsBarcodeReader *reader, byte *pkg);
+static void DispatchDecode(mlsBarcodeReader *reader);
+static void AppendDecode(mlsBarcodeReader *reader, const byte *data, int len);
+static void SetDecodeDest(mlsBarcodeReader *reader, char *dest, int destLen);
+static void CountNAK(mlsBarcodeReader *reader, byte cause);
+static void FillResult(mlsBarcodeReader *reader, mlsBarcodeResult *result, char *data);
+static void KeepPendingDecode(mlsBarcodeReader *reader);
+static int TakePendingDecode(mlsBarcodeReader *reader, mlsBarcodeResult *result, char *buff, int buffLength);
+static int PeekDecodeLen(mlsBarcodeReader *reader);
+
+typedef enum _state {START, STOP, FLUSH_QUEUE, GET_BARCODE, WAIT_DEC_EVENT} ssiState;
+
+// What ParseInput() stopped at, also used as mask of what ReadSSI() waits for
+typedef enum _pkgEvent {PKG_NONE = 0, PKG_DECODE = 1, PKG_REPLY = 2, PKG_PARAM = 4, PKG_DROPPED = 8} pkgEvent;
+
+// Context behind the legacy single-scanner API
+static mlsBarcodeReader defaultReader = { .fd = -1, .retryLimit = DEFAULT_RETRY_LIMIT,
+		.ioLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP };
+
+// Parameterless host command package, checksum computed at compile time
+#define CMD_CKSUM(op)		((uint16_t) (0x10000 - (SSI_HEADER_LEN + (op) + SSI_HOST + SSI_DEFAULT_STATUS)))
+#define CMD_PKG(op)			{ SSI_HEADER_LEN, (op), SSI_HOST, SSI_DEFAULT_STATUS, \
+								MSB_16(CMD_CKSUM(op)), LSB_16(CMD_CKSUM(op)) }
+#define CMD_PKG_LEN			(SSI_HEADER_LEN + SSI_CKSUM_LEN)
+
+static const byte ackPkg[CMD_PKG_LEN] = CMD_PKG(SSI_CMD_ACK);
+static const byte startSessionPkg[CMD_PKG_LEN] = CMD_PKG(SSI_START_SESSION);
+static const byte stopSessionPkg[CMD_PKG_LEN] = CMD_PKG(SSI_STOP_SESSION);
+static const byte scanEnablePkg[CMD_PKG_LEN] = CMD_PKG(SSI_SCAN_ENABLE);
+static const byte scanDisablePkg[CMD_PKG_LEN] = CMD_PKG(SSI_SCAN_DISABLE);
+static const byte flushQueuePkg[CMD_PKG_LEN] = CMD_PKG(SSI_FLUSH_QUEUE);
+
+/*!
+ * \brief mlsBarcodeReader_Create allocate a reader context for one scanner
+ * \return
+ * - pointer to new reader context: Success
+ * - NULL: Fail
+ */
+mlsBarcodeReader *mlsBarcodeReader_Create(void)
+{
+	mlsBarcodeReader *reader = calloc(1, sizeof(*reader));
+	pthread_mutexattr_t attr;
+
+	if (NULL == reader)
+	{
+		LOG_ERRNO(__func__);
+		return NULL;
+	}
 
-typedef enum _state {START, STOP, FLUSH_QUEUE, REPLY_ACK, REPLY_NAK, GET_BARCODE, WAIT_DEC_EVENT} ssiState;
+	reader->fd = -1;
+	reader->retryLimit = DEFAULT_RETRY_LIMIT;
 
-static int scanner = 0;
+	// Recursive: decode callbacks may send commands to their own scanner
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&reader->ioLock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return reader;
+}
 
 /*!
- * \brief mlsBarcodeReader_Open Open Reader descritptor file for read write
+ * \brief mlsBarcodeReader_Destroy stop reader thread, close scanner if still opened and free reader context
+ */
+void mlsBarcodeReader_Destroy(mlsBarcodeReader *reader)
+{
+	if (NULL == reader)
+	{
+		return;
+	}
+
+	// Also when reconnecting: fd is -1 but the reader thread is still running
+	mlsBarcodeReader_Close_r(reader);
+
+	mlsBarcodeCapture_Close(reader);
+	mlsBarcodeRing_Destroy(reader->queue);
+	pthread_mutex_destroy(&reader->ioLock);
+	free(reader);
+}
+
+/*!
+ * \brief mlsBarcodeReader_Open_r Open Reader descritptor file for read write
  * \return
  * - EXIT_SUCCESS: Success
  * - EXIT_FAILURE: Fail
  */
-char mlsBarcodeReader_Open(char *name) {
+char mlsBarcodeReader_Open_r(mlsBarcodeReader *reader, char *name) {
 	char ret = EXIT_SUCCESS;
-	const char *debugLevel = getenv("STYL_DEBUG");
+	int fd = -1;
 
+	assert(reader != NULL);
 	assert(name != NULL);
 
-	if (NULL != debugLevel) {
-		printf("DEBUG: %s\n", name);
+	LOG_DEBUG("%s", name);
+
+	if (name != reader->name)
+	{
+		strncpy(reader->name, name, MAX_DEV_NAME_LEN - 1);
+		reader->name[MAX_DEV_NAME_LEN - 1] = '\0';
+	}
+
+	// Preallocate decode queue so that no allocation happens while scanning
+	if ( (0 < reader->queueSize) && (NULL == reader->queue) )
+	{
+		reader->queue = mlsBarcodeRing_Create(reader->queueSize);
+		if (NULL == reader->queue)
+		{
+			ret = EXIT_FAILURE;
+			goto EXIT;
+		}
 	}
 
-	ret = OpenTTY(name);
-	if (ret <= 0)
+	fd = OpenTTY(name);
+	if (0 > fd)
 	{
 		ret = EXIT_FAILURE;
 		goto EXIT;
 	}
 	else
 	{
-		scanner = ret;
+		// Read without ioLock by mlsBarcodeReader_IsConnected()
+		__atomic_store_n(&reader->fd, fd, __ATOMIC_RELAXED);
+	}
+
+	reader->rxLen = 0;
+	reader->decodeLen = 0;
+	reader->decodePackets = 0;
+	reader->hasSavedConf = (0 == tcgetattr(reader->fd, &reader->savedConf));
+
+	ret = (char) ConfigTTY(reader);
+	if (ret)
+	{
+		LOG_ERROR("%s: %s", __func__, reader->name);
+		goto EXIT;
 	}
 
-	ret = (char) ConfigTTY(scanner);
+	// Before ConfigSSI so that no other command is waiting for ACK
+	ret = (char) NegotiateBaudRate(reader);
 	if (ret)
 	{
-		printf("%s: ERROR\n", __func__);
+		LOG_ERROR("%s: %s", __func__, reader->name);
 		goto EXIT;
 	}
 
-	ret = (char) ConfigSSI(scanner);
+	ret = (char) ConfigSSI(reader);
 	if (ret)
 	{
-		printf("%s: ERROR\n", __func__);
+		LOG_ERROR("%s: %s", __func__, reader->name);
 		goto EXIT;
 	}
 
 EXIT:
+	// Release the scanner lock, otherwise a retried open finds the device busy
+	if ( (EXIT_SUCCESS != ret) && (0 <= fd) )
+	{
+		if (reader->hasSavedConf)
+		{
+			tcsetattr(fd, TCSANOW, &reader->savedConf);
+		}
+		mlsBarcodeReader_Detach(reader);
+	}
+
 	return ret;
 }
 
 /*!
- * \brief mlsBarcodeReader_ReadData Reader data from descriptor file (blocking read)
+ * \brief mlsBarcodeReader_ReadData_r Reader data from descriptor file (blocking read)
  * \param buff point to buffer which store data.
+ * \param timeout maximum wait time in 1/10 second
+ * \return number of byte(s) read.
+ */
+unsigned int mlsBarcodeReader_ReadData_r(mlsBarcodeReader *reader, char *buff, const int buffLength, const int timeout) {
+	assert(timeout >= 0);
+
+	return ReadData(reader, buff, buffLength, timeout * 100);
+}
+
+/*!
+ * \brief mlsBarcodeReader_ReadDataMs same as mlsBarcodeReader_ReadData_r() with timeout in milliseconds
+ * \param timeoutMs maximum wait time in milliseconds, -1 to wait forever
+ * \return number of byte(s) read.
+ */
+unsigned int mlsBarcodeReader_ReadDataMs(mlsBarcodeReader *reader, char *buff, const int buffLength, const int timeoutMs)
+{
+	assert(timeoutMs >= -1);
+
+	return ReadData(reader, buff, buffLength, timeoutMs);
+}
+
+/*!
+ * \brief mlsBarcodeReader_SetCommandTimeout set how long commands wait for ACK/NAK
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetCommandTimeout(mlsBarcodeReader *reader, int timeoutMs)
+{
+	if ( (NULL == reader) || (0 > timeoutMs) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	reader->commandTimeoutMs = timeoutMs;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_SetRetryLimit set how many times a command is written again
+ * after NAK RESEND or missing reply
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetRetryLimit(mlsBarcodeReader *reader, int retries)
+{
+	if ( (NULL == reader) || (0 > retries) || (MLS_BARCODE_MAX_RETRIES < retries) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	reader->retryLimit = retries;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief ReadData wait for a decode event and copy barcode to buff
  * \return number of byte(s) read.
  */
-unsigned int mlsBarcodeReader_ReadData(char *buff, const int buffLength, const int timeout) {
+static unsigned int ReadData(mlsBarcodeReader *reader, char *buff, const int buffLength, const int timeoutMs)
+{
 	int barcodeLen = 0;
 	int ret = 0;
 	ssiState currentState = WAIT_DEC_EVENT;
 	ssiState nextState = WAIT_DEC_EVENT;
-	ssiState previousState = WAIT_DEC_EVENT;
 	int isInSession = TRUE;
-	byte recvBuff[4000] = {0};
-	const char *debugLevel = getenv("STYL_DEBUG");
 
-	assert( (timeout >= 0) && (timeout <= 25) );
+	assert(reader != NULL);
 
+	pthread_mutex_lock(&reader->ioLock);
 	while (isInSession)
 	{
 		switch (currentState) {
 			case START:
-				if (NULL != debugLevel)
-				{
-					printf("Send Start session cmd...");
-				}
-
-				ret = WriteSSI(scanner, SSI_START_SESSION, NULL, 0);
-				if ( (ret) || (! CheckACK(scanner) ) )
+				ret = SendCommand(reader, SSI_START_SESSION, NULL, 0);
+				if (ret)
 				{
-					if (NULL != debugLevel)
-					{
-						PrintError(ret);
-					}
+					PrintError(ret);
 					nextState = STOP;
 				}
 				else
 				{
-					if (NULL != debugLevel)
-					{
-						printf("OK\n");
-					}
+					LOG_DEBUG("Send Start session cmd: OK");
 				}
 
 				break;
@@ -155,9 +337,9 @@ unsigned int mlsBarcodeReader_ReadData(char *buff, const int buffLength, const i
 			case STOP:
 				isInSession = FALSE;
 //				printf("Send Stop session cmd...");
-//				ret = WriteSSI(scanner, SSI_STOP_SESSION, NULL, 0);
+//				ret = SendCommand(reader, SSI_STOP_SESSION, NULL, 0);
 //				usleep(1000);
-//				if ( (ret) || (! CheckACK(scanner) ) )
+//				if (ret)
 //				{
 //					PrintError(ret);
 //				}
@@ -165,379 +347,1075 @@ unsigned int mlsBarcodeReader_ReadData(char *buff, const int buffLength, const i
 //				{
 				/* TODO: need to research if auto detect accept STOP_SESSION */
 					ret = barcodeLen;
-				if (NULL != debugLevel)
-				{
-					printf("OK\n");
-				}
 //				}
 				break;
 
 			case WAIT_DEC_EVENT:
-
-				if (NULL != debugLevel)
+				// Barcode completed while a command waited for its reply comes first
+				if (reader->pending.isPending)
 				{
-					printf("Wait for decode event...");
-				}
-				ret = ReadSSI(scanner, recvBuff, timeout);
-				if (ret <= 0)
-				{
-					if (NULL != debugLevel)
-					{
-						printf("NOT found\n");
-					}
+					barcodeLen = TakePendingDecode(reader, NULL, buff, buffLength);
 					nextState = STOP;
+					break;
 				}
-				else
-				{
-					if (NULL != debugLevel)
-					{
-						printf("OK\n");
-					}
-					nextState = REPLY_ACK;
-					previousState = currentState;
-				}
-				break;
 
-			case REPLY_ACK:
-				ret = WriteSSI(scanner, SSI_CMD_ACK, NULL, 0);
-				if (ret)
+				// Event and decode data packages are ACKed while being parsed
+				// Reassemble straight into caller buffer, no intermediate copy
+				SetDecodeDest(reader, buff, buffLength);
+				ret = ReadSSI(reader, PKG_DECODE, timeoutMs);
+				if (PKG_DECODE != ret)
 				{
-					PrintError(ret);
+					// Keep partial barcode for next call, caller buffer is only valid now
+					SetDecodeDest(reader, NULL, 0);
+					LOG_DEBUG("Wait for decode event: NOT found");
 					nextState = STOP;
 				}
 				else
 				{
-
-					if (NULL != debugLevel)
-					{
-						printf("OK\n");
-					}
-					switch (previousState)
-					{
-						case WAIT_DEC_EVENT:
-							nextState = GET_BARCODE;
-							break;
-						case GET_BARCODE:
-							nextState = STOP;
-						default:
-							break;
-					}
+					nextState = GET_BARCODE;
 				}
-				previousState = currentState;
-				break;
-
-			case REPLY_NAK:
 				break;
 
 			case GET_BARCODE:
-				// Receive barcode in formatted package
-				if (NULL != debugLevel)
-				{
-					printf("Receive data: \n");
-				}
-				ret = ReadSSI(scanner, recvBuff, timeout);
-				if (ret <= 0)
-				{
-					buff = NULL;
-					nextState = STOP;
-				}
-				else
+				// Barcode is already in caller buffer
+				mlsBarcodeLatency_Record(reader);
+				barcodeLen = reader->decodeLen;
+				if (reader->decodeTruncated)
 				{
-					// Extract barcode to buffer
-					assert(NULL != recvBuff);
-					barcodeLen = ExtractBarcode(buff, recvBuff, buffLength);
-					if (NULL != debugLevel) {
-						DisplayPkg(recvBuff);
-					}
-					nextState = REPLY_ACK;
-					previousState = currentState;
+					LOG_ERROR("%s: barcode truncated, %u byte(s) dropped", __func__, reader->decodeTruncated);
 				}
+				reader->decodeLen = 0;
+				reader->decodePackets = 0;
+				SetDecodeDest(reader, NULL, 0);
+				nextState = STOP;
 				break;
 
 			case FLUSH_QUEUE:
-				if (NULL != debugLevel) {
-					printf("Send Scan disable cmd...");
-				}
-
-				ret = WriteSSI(scanner, SSI_SCAN_DISABLE, NULL, 0);
-				if ( (ret) || (! CheckACK(scanner) ) )
-				{
-					PrintError(ret);
-					nextState = STOP;
-					break;
-				}
-				else
-				{
-					if (NULL != debugLevel)
-					{
-						printf("OK\n");
-					}
-				}
-
-				if (NULL != debugLevel) {
-					printf("Send flush queue cmd...");
-				}
-
-				ret = WriteSSI(scanner, SSI_FLUSH_QUEUE, NULL, 0);
-				if ( (ret) || (! CheckACK(scanner) ) )
-				{
-					PrintError(ret);
-					nextState = STOP;
-					break;
-				}
-				else
+			{
+				// Disable, flush and re-enable in one round trip
+				mlsBarcodeCommand rearm[] = {
+					{ .opcode = SSI_SCAN_DISABLE },
+					{ .opcode = SSI_FLUSH_QUEUE },
+					{ .opcode = SSI_SCAN_ENABLE }
+				};
+
+				ret = SendBatch(reader, rearm, sizeof(rearm) / sizeof(*rearm));
+				if (ret)
 				{
-					if (NULL != debugLevel)
+					for (unsigned int i = 0; i < sizeof(rearm) / sizeof(*rearm); i++)
 					{
-						printf("OK\n");
+						PrintError(rearm[i].result);
 					}
-				}
-
-				if (NULL != debugLevel) {
-					printf("Send Scan enable cmd...");
-				}
-
-				ret = WriteSSI(scanner, SSI_SCAN_ENABLE, NULL, 0);
-				if ( (ret) || (! CheckACK(scanner) ) )
-				{
-					PrintError(ret);
 					nextState = STOP;
-					break;
 				}
 				else
 				{
-					if (NULL != debugLevel) {
-						printf("OK\n");
-					}
+					LOG_DEBUG("Send Scan disable, flush queue, Scan enable cmds: OK");
 				}
 
 				break;
+			}
 
 			default:
 				break;
 		}
 		currentState = nextState;
 	}
+	pthread_mutex_unlock(&reader->ioLock);
 
-	if (NULL != debugLevel)
-	{
-		printf("Barcode Len = %d\n", ret);
-	}
+	LOG_DEBUG("Barcode Len = %d", ret);
 	return ret;
 }
 
 /*!
- * \brief mlsBarcodeReader_Enable Enable Reader for scaning QR code/Bar Code
+ * \brief mlsBarcodeReader_Enable_r Enable Reader for scaning QR code/Bar Code
  * \return
  * - EXIT_SUCCESS: Success
  * - EXIT_SUCCESS: Fail
  */
-char mlsBarcodeReader_Enable()
+char mlsBarcodeReader_Enable_r(mlsBarcodeReader *reader)
 {
-	char ret = EXIT_SUCCESS;
-	const char *debugLevel = getenv("STYL_DEBUG");
-	
-	if (NULL != debugLevel) {
-		printf("Enable scanner...");
-	}
+	int ret = EXIT_SUCCESS;
+
+	assert(reader != NULL);
 
-	ret = WriteSSI(scanner, SSI_SCAN_ENABLE, NULL, 0);
-	if ( (ret) || (! CheckACK(scanner) ) )
+	ret = SendCommand(reader, SSI_SCAN_ENABLE, NULL, 0);
+	if (ret)
 	{
 		PrintError(ret);
 		ret = EXIT_FAILURE;
 	}
 	else
 	{
-		if (NULL != debugLevel) {
-			printf("OK\n");
-		}
+		LOG_DEBUG("Enable scanner: OK");
 	}
 
 	return ret;
 }
 
 /*!
- * \brief mlsBarcodeReader_Disable Disable reader, Reader can't scan any QR code/bar code
+ * \brief mlsBarcodeReader_Disable_r Disable reader, Reader can't scan any QR code/bar code
  * \return
  * - EXIT_SUCCESS: Success
  * - EXIT_SUCCESS: Fail
  */
-char mlsBarcodeReader_Disable()
+char mlsBarcodeReader_Disable_r(mlsBarcodeReader *reader)
 {
-	char ret = EXIT_SUCCESS;
-	const char *debugLevel = getenv("STYL_DEBUG");
+	int ret = EXIT_SUCCESS;
 
-	if (NULL != debugLevel) {
-		printf("Disable scanner...");
-	}
+	assert(reader != NULL);
 
-	ret = WriteSSI(scanner, SSI_SCAN_DISABLE, NULL, 0);
-	if ( (ret) || (! CheckACK(scanner) ) )
+	ret = SendCommand(reader, SSI_SCAN_DISABLE, NULL, 0);
+	if (ret)
 	{
 		PrintError(ret);
 		ret = EXIT_FAILURE;
 	}
 	else
 	{
-		if (NULL != debugLevel) {
-			printf("OK\n");
-		}
+		LOG_DEBUG("Disable scanner: OK");
 	}
 
 	return ret;
 }
 
 /*!
- * \brief mlsBarcodeReader_close close Reader file descriptor
+ * \brief mlsBarcodeReader_ReadResult wait for a barcode and fill result with it and its metadata
  * \return
- * - EXIT_SUCCESS: Success
- * - EXIT_FAILURE: Fail
+ * - EXIT_SUCCESS: result is filled
+ * - EXIT_FAILURE: timeout or error
  */
-char mlsBarcodeReader_Close() {
-	char error = EXIT_SUCCESS;
-
-	error = close(scanner);
-	if (error) {
-		perror(__func__);
-	}
+char mlsBarcodeReader_ReadResult(mlsBarcodeReader *reader, mlsBarcodeResult *result, char *buff,
+		const int buffLength, const int timeoutMs)
+{
+	char ret = EXIT_FAILURE;
 
-	UnlockScanner();
-	
-	return error;
-}
+	assert(reader != NULL);
+	assert( (result != NULL) && (buff != NULL) );
+	assert(timeoutMs >= -1);
 
-/*!
- * \brief GetVersion provide software version
- * \return string of software version
- * - 
- */
-char *GetVersion(void)
-{
-	return STYL_SW_VERSION;
-}
+	pthread_mutex_lock(&reader->ioLock);
 
-/*!
- * \brief mlsBarcodeReader_Reopen closes then opens device
- * \return
- * - EXIT_SUCCESS: Success
- * - EXIT_FAILURE: Fail
- */
-char mlsBarcodeReader_Reopen(char *name) {
-	char error = EXIT_SUCCESS;
+	if (reader->pending.isPending)
+	{
+		TakePendingDecode(reader, result, buff, buffLength);
+		pthread_mutex_unlock(&reader->ioLock);
+		return EXIT_SUCCESS;
+	}
 
-	error = mlsBarcodeReader_Close();
-	
-	if(!error) {
-		error = mlsBarcodeReader_Open(name);
+	SetDecodeDest(reader, buff, buffLength);
+	if (PKG_DECODE == ReadSSI(reader, PKG_DECODE, timeoutMs))
+	{
+		FillResult(reader, result, buff);
+		ret = EXIT_SUCCESS;
 	}
+	SetDecodeDest(reader, NULL, 0);
 
-	return error;
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return ret;
 }
 
 /*!
- * \brief strNAK generate NAK message based on code
- * \return NAK message string
+ * \brief mlsBarcodeReader_ReadStream wait for a barcode, then take every further barcode
+ * already received without waiting again
+ * \return
+ * - number of results filled, 0 on timeout
+ * - -1: read error
  */
-static char *strNAK(int code)
+int mlsBarcodeReader_ReadStream(mlsBarcodeReader *reader, mlsBarcodeResult *results, unsigned int maxCount,
+		char *buff, const int buffLength, const int timeoutMs)
 {
-	char *msg = NULL;
+	unsigned int count = 0;
+	int offset = 0;
+	int needed = 0;
+	int ret = PKG_NONE;
 
-	switch (code) {
-		case NAK_RESEND:
-			msg = "RESEND";
-			break;
+	assert(reader != NULL);
+	assert( (results != NULL) && (buff != NULL) );
+	assert(timeoutMs >= -1);
 
-		case NAK_CANCEL:
-			msg = "CANCEL";
-			break;
+	if (0 == maxCount)
+	{
+		return 0;
+	}
 
-		case NAK_DENIED:
-			msg = "DENIED";
-			break;
+	pthread_mutex_lock(&reader->ioLock);
 
-		case NAK_BAD_CONTEXT:
-			msg = "NAK_BAD_CONTEXT";
+	if (reader->pending.isPending)
+	{
+		// Completed while a command waited for its reply, no need to wait
+		TakePendingDecode(reader, &results[count++], buff, buffLength);
+	}
+	else
+	{
+		// First barcode may use the whole buffer, a partial one from last call included
+		SetDecodeDest(reader, buff, buffLength);
+		ret = ReadSSI(reader, PKG_DECODE, timeoutMs);
+		if (PKG_DECODE != ret)
+		{
+			SetDecodeDest(reader, NULL, 0);
+			pthread_mutex_unlock(&reader->ioLock);
+			return (0 > ret) ? -1 : 0;
+		}
+		FillResult(reader, &results[count++], buff);
+	}
+	offset = results[0].length;
+
+	// Following barcodes only if complete in rxBuff and fitting in the rest of buff,
+	// otherwise they stay in the reader for next call
+	while (count < maxCount)
+	{
+		needed = PeekDecodeLen(reader);
+		if (0 > needed)
+		{
+			// Nothing complete yet: take what kernel has, without waiting
+			if ( (RX_BUFF_LEN == reader->rxLen) || (0 >= WaitInput(reader->fd, 0)) || (0 >= ReadInput(reader)) )
+			{
+				break;
+			}
+			continue;
+		}
+		if (reader->decodeLen + needed > buffLength - offset)
+		{
 			break;
+		}
 
-		default:
+		SetDecodeDest(reader, &buff[offset], buffLength - offset);
+		ret = ParseInput(reader);
+		if (PKG_DECODE == ret)
+		{
+			FillResult(reader, &results[count], &buff[offset]);
+			offset += results[count].length;
+			count++;
+		}
+		else if (PKG_NONE == ret)
+		{
 			break;
+		}
 	}
+	SetDecodeDest(reader, NULL, 0);
 
-	return msg;
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return (int) count;
 }
 
 /*!
- * \brief CalculateChecksum calculate 2's complement of pkg
- * \return 16 bits checksum (2' complement) value
+ * \brief FillResult describe barcode just completed in data, then release it
  */
-static uint16_t CalculateChecksum(byte *pkg)
+static void FillResult(mlsBarcodeReader *reader, mlsBarcodeResult *result, char *data)
 {
-	int checksum = 0;
-
-	for (unsigned int i = 0; i < PKG_LEN(pkg); i++)
-	{
-		checksum += pkg[i];
-	}
-
-	// 1's complement
-	checksum ^= 0xFFFF;	// flip all 16 bits
-
-	// 2's complement
-	checksum += 1;
-
-	return checksum;
+	mlsBarcodeLatency_Record(reader);
+	result->symbology = reader->decodeType;
+	result->data = data;
+	result->length = reader->decodeLen;
+	result->truncatedLen = reader->decodeTruncated;
+	result->deviceId = reader->name;
+	result->firstTimestamp = reader->decodeTime;
+	result->timestamp = reader->rxTime;
+	result->packetCount = reader->decodePackets;
+
+	reader->decodeLen = 0;
+	reader->decodePackets = 0;
 }
 
 /*!
- * \brief PreparePkg generate package from input opcode and params
+ * \brief KeepPendingDecode keep barcode just completed in decodeBuff for the next read.
+ * Only one is kept: a second one before that read is dropped and counted in queueDrops.
  */
-static void PreparePkg(byte *pkg, byte opcode, byte *param, byte paramLen)
+static void KeepPendingDecode(mlsBarcodeReader *reader)
 {
-	uint16_t checksum = 0;
+	mlsBarcodePendingDecode *pending = &reader->pending;
 
-	pkg[INDEX_LEN] = SSI_HEADER_LEN;
-	pkg[INDEX_OPCODE] = opcode;
-	pkg[INDEX_SRC] = SSI_HOST;
-	pkg[INDEX_STAT] = SSI_DEFAULT_STATUS;
-
-	if ( (NULL != param) && (0 != paramLen) )
+	if (pending->isPending)
 	{
-		pkg[INDEX_LEN] += paramLen;
-		memcpy(&pkg[INDEX_STAT + 1], param, paramLen);
+		COUNTER_ADD(reader, queueDrops, 1);
+		LOG_WARNING("%s: barcode dropped, previous one not read yet", reader->name);
+		return;
 	}
 
-	// add checksum
-	checksum = CalculateChecksum(pkg);
-	pkg[PKG_LEN(pkg)] = checksum >> 8;
-	pkg[PKG_LEN(pkg) + 1] = checksum & 0xFF;
+	memcpy(pending->data, reader->decodeBuff, reader->decodeLen);
+	pending->length = reader->decodeLen;
+	pending->truncatedLen = reader->decodeTruncated;
+	pending->packets = reader->decodePackets;
+	pending->symbology = reader->decodeType;
+	pending->firstTime = reader->decodeTime;
+	pending->time = reader->rxTime;
+	pending->isPending = TRUE;
 }
 
 /*!
- * \brief IsChecksumOK check 2 last bytes for checksum
- * \return
- * - TRUE: checksum is correct
- * - FALSE: checksum is incorrect
+ * \brief TakePendingDecode copy kept barcode to buff and describe it in result, if not NULL
+ * \return number of bytes copied
  */
-static int IsChecksumOK(byte *pkg)
+static int TakePendingDecode(mlsBarcodeReader *reader, mlsBarcodeResult *result, char *buff, int buffLength)
 {
-	uint16_t cksum = 0;
+	mlsBarcodePendingDecode *pending = &reader->pending;
+	int len = (pending->length < buffLength) ? pending->length : buffLength;
+	unsigned int truncatedLen = pending->truncatedLen + (unsigned int) (pending->length - len);
 
-	cksum += pkg[PKG_LEN(pkg) + 1];
-	cksum += pkg[PKG_LEN(pkg)] << 8;
-
-	return (cksum == CalculateChecksum(pkg));
-}
+	memcpy(buff, pending->data, len);
+	pending->isPending = FALSE;
+
+	if (NULL != result)
+	{
+		result->symbology = pending->symbology;
+		result->data = buff;
+		result->length = len;
+		result->truncatedLen = truncatedLen;
+		result->deviceId = reader->name;
+		result->firstTimestamp = pending->firstTime;
+		result->timestamp = pending->time;
+		result->packetCount = pending->packets;
+	}
+
+	// Unless the next barcode has started already, see mlsBarcodeReader_GetTruncatedLen()
+	if (0 == reader->decodePackets)
+	{
+		reader->decodeTruncated = truncatedLen;
+	}
+	if (truncatedLen)
+	{
+		LOG_ERROR("%s: barcode truncated, %u byte(s) dropped", reader->name, truncatedLen);
+	}
+
+	return len;
+}
+
+/*!
+ * \brief PeekDecodeLen payload length of the next barcode in rxBuff, without parsing it
+ * \return
+ * - payload bytes still to be appended to the current barcode
+ * - -1: barcode is not complete in rxBuff, or other packages come first
+ */
+static int PeekDecodeLen(mlsBarcodeReader *reader)
+{
+	const byte *pkg = NULL;
+	int offset = 0;
+	int len = 0;
+
+	while (offset < reader->rxLen)
+	{
+		pkg = &reader->rxBuff[offset];
+		if ( (PKG_LEN(pkg) < SSI_HEADER_LEN) || (reader->rxLen - offset < SSI_FRAME_LEN(pkg)) )
+		{
+			return -1;
+		}
+
+		if (SSI_DEC_DATA == pkg[INDEX_OPCODE])
+		{
+			len += PKG_LEN(pkg) - SSI_HEADER_LEN - 1;
+			if (! SSI_IS_CONTINUE(pkg))
+			{
+				return len;
+			}
+		}
+		else if (SSI_EVENT != pkg[INDEX_OPCODE])
+		{
+			return -1;
+		}
+		offset += SSI_FRAME_LEN(pkg);
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief mlsBarcodeReader_SetSymbologyFilter only deliver barcodes of the given symbologies
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetSymbologyFilter(mlsBarcodeReader *reader, const unsigned char *symbologies,
+		unsigned int count)
+{
+	uint32_t deny[MLS_SYMBOLOGY_COUNT / 32];
+
+	if ( (NULL == reader) || ( (NULL == symbologies) && (0 != count) ) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	memset(deny, (0 == count) ? 0x00 : 0xFF, sizeof(deny));
+	for (unsigned int i = 0; i < count; i++)
+	{
+		deny[symbologies[i] / 32] &= ~(1U << (symbologies[i] % 32));
+	}
+
+	pthread_mutex_lock(&reader->ioLock);
+	memcpy(reader->symbologyDeny, deny, sizeof(deny));
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_GetTruncatedLen number of bytes dropped from the last barcode
+ * because it did not fit in the caller buffer (ReadData_r) or MLS_BARCODE_MAX_LEN
+ * \return 0 if last barcode was complete
+ */
+unsigned int mlsBarcodeReader_GetTruncatedLen(mlsBarcodeReader *reader)
+{
+	assert(reader != NULL);
+
+	return reader->decodeTruncated;
+}
+
+/*!
+ * \brief mlsBarcodeReader_Close_r close Reader file descriptor
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_Close_r(mlsBarcodeReader *reader) {
+	char error = EXIT_SUCCESS;
+
+	assert(reader != NULL);
+
+	if (reader->isThreadRunning)
+	{
+		mlsBarcodeReader_StopThread(reader);
+	}
+
+	// Thread was stopped while waiting for the scanner to come back
+	if (0 > reader->fd)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	RestoreBaudRate(reader);
+
+	if (reader->hasSavedConf)
+	{
+		tcsetattr(reader->fd, TCSANOW, &reader->savedConf);
+		reader->hasSavedConf = FALSE;
+	}
+
+	reader->pending.isPending = FALSE;
+
+	UnlockScanner(reader->fd);
+	error = close(reader->fd);
+	if (error) {
+		LOG_ERRNO(__func__);
+	}
+	__atomic_store_n(&reader->fd, -1, __ATOMIC_RELAXED);
+
+	return error;
+}
+
+/*!
+ * \brief GetVersion provide software version
+ * \return string of software version
+ * - 
+ */
+char *GetVersion(void)
+{
+	return STYL_SW_VERSION;
+}
+
+/*!
+ * \brief mlsBarcodeReader_Reopen_r closes then opens device
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_Reopen_r(mlsBarcodeReader *reader, char *name) {
+	char error = EXIT_SUCCESS;
+
+	COUNTER_ADD(reader, reopens, 1);
+	error = mlsBarcodeReader_Close_r(reader);
+	
+	if(!error) {
+		error = mlsBarcodeReader_Open_r(reader, name);
+	}
+
+	return error;
+}
+
+/*!
+ * \brief mlsBarcodeReader_SendBatch write several commands back to back, then match
+ * their ACK/NAK replies in order
+ * \return
+ * - EXIT_SUCCESS: every command ACKed
+ * - EXIT_FAILURE: at least one command failed, see commands[i].result
+ */
+char mlsBarcodeReader_SendBatch(mlsBarcodeReader *reader, mlsBarcodeCommand *commands, unsigned int count)
+{
+	assert(reader != NULL);
+	assert( (commands != NULL) || (0 == count) );
+
+	return (char) SendBatch(reader, commands, count);
+}
+
+/*!
+ * \brief mlsBarcodeReader_SetBaudRate select baud rate negotiated at next open
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: unsupported baud rate
+ */
+char mlsBarcodeReader_SetBaudRate(mlsBarcodeReader *reader, unsigned int baudRate)
+{
+	speed_t speed = BAUDRATE;
+	byte code = PARAM_BAUD_9600;
+
+	if ( (NULL == reader) || (GetBaudCode(baudRate, &speed, &code)) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	reader->baudRate = baudRate;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_SetTTYProfile select tty settings applied at next open
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetTTYProfile(mlsBarcodeReader *reader, mlsBarcodeTTYProfile profile)
+{
+	if ( (NULL == reader) ||
+			( (MLS_TTY_PROFILE_DEFAULT != profile) && (MLS_TTY_PROFILE_LOW_LATENCY != profile) ) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	reader->ttyProfile = profile;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_SetCallback register decode event handler of a reader context
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetCallback(mlsBarcodeReader *reader, mlsBarcodeReader_Callback callback, void *userData)
+{
+	if (NULL == reader)
+	{
+		return EXIT_FAILURE;
+	}
+
+	reader->callback = callback;
+	reader->userData = userData;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_ServiceInput read all pending bytes from scanner, ACK and
+ * dispatch complete packages. Scanner descriptor must be in non-blocking mode.
+ * \return
+ * - number of decode events dispatched to reader callback
+ * - -1: read error or device hang up
+ */
+int mlsBarcodeReader_ServiceInput(mlsBarcodeReader *reader)
+{
+	int decodeCount = 0;
+	int ret = 0;
+
+	assert(reader != NULL);
+
+	pthread_mutex_lock(&reader->ioLock);
+
+	// Level-triggered: one read per wake up, the rest is picked up next round.
+	// Nothing is read while rxBuff is full, parsing below makes room first.
+	ret = ReadInput(reader);
+	if (0 > ret)
+	{
+		decodeCount = -1;
+		goto EXIT;
+	}
+
+	while (PKG_NONE != (ret = ParseInput(reader)))
+	{
+		if (PKG_DECODE == ret)
+		{
+			DispatchDecode(reader);
+			decodeCount++;
+		}
+	}
+
+EXIT:
+	pthread_mutex_unlock(&reader->ioLock);
+	return decodeCount;
+}
+
+/*!
+ * \brief mlsBarcodeReader_FeedInput handle bytes as if they were read from scanner:
+ * ACK and dispatch complete packages like mlsBarcodeReader_ServiceInput()
+ * \return number of decode events dispatched to reader callback
+ */
+int mlsBarcodeReader_FeedInput(mlsBarcodeReader *reader, const byte *data, int len)
+{
+	int decodeCount = 0;
+	int partLen = 0;
+	int ret = 0;
+
+	assert(reader != NULL);
+	assert( (data != NULL) || (0 == len) );
+
+	pthread_mutex_lock(&reader->ioLock);
+
+	while (0 < len)
+	{
+		partLen = RX_BUFF_LEN - reader->rxLen;
+		if (partLen > len)
+		{
+			partLen = len;
+		}
+
+		memcpy(&reader->rxBuff[reader->rxLen], data, partLen);
+		COUNTER_ADD(reader, bytesRx, partLen);
+		clock_gettime(CLOCK_MONOTONIC, &reader->rxTime);
+		if (0 == reader->rxLen)
+		{
+			reader->rxStartTime = reader->rxTime;
+		}
+		reader->rxLen += partLen;
+		data += partLen;
+		len -= partLen;
+
+		while (PKG_NONE != (ret = ParseInput(reader)))
+		{
+			if (PKG_DECODE == ret)
+			{
+				DispatchDecode(reader);
+				decodeCount++;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&reader->ioLock);
+	return decodeCount;
+}
+
+/*!
+ * \brief mlsBarcodeReader_Detach release descriptor and lock of a scanner which is gone.
+ * Unlike mlsBarcodeReader_Close_r() the reader thread and decode queue are kept.
+ */
+void mlsBarcodeReader_Detach(mlsBarcodeReader *reader)
+{
+	pthread_mutex_lock(&reader->ioLock);
+
+	if (0 <= reader->fd)
+	{
+		UnlockScanner(reader->fd);
+		close(reader->fd);
+	}
+	__atomic_store_n(&reader->fd, -1, __ATOMIC_RELAXED);
+	reader->hasSavedConf = FALSE;
+	reader->rxLen = 0;
+	reader->decodeLen = 0;
+	reader->decodePackets = 0;
+	reader->lastRxKey = 0;
+
+	pthread_mutex_unlock(&reader->ioLock);
+}
+
+/*
+ * Legacy single-scanner API: thin wrappers over defaultReader
+ */
+
+/*!
+ * \brief mlsBarcodeReader_Open Open Reader descritptor file for read write
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_Open(char *name)
+{
+	return mlsBarcodeReader_Open_r(&defaultReader, name);
+}
+
+/*!
+ * \brief mlsBarcodeReader_ReadData Reader data from descriptor file (blocking read)
+ * \param buff point to buffer which store data.
+ * \return number of byte(s) read.
+ */
+unsigned int mlsBarcodeReader_ReadData(char *buff, const int buffLength, const int timeout)
+{
+	return mlsBarcodeReader_ReadData_r(&defaultReader, buff, buffLength, timeout);
+}
+
+/*!
+ * \brief mlsBarcodeReader_Enable Enable Reader for scaning QR code/Bar Code
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_Enable()
+{
+	return mlsBarcodeReader_Enable_r(&defaultReader);
+}
+
+/*!
+ * \brief mlsBarcodeReader_Disable Disable reader, Reader can't scan any QR code/bar code
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_Disable()
+{
+	return mlsBarcodeReader_Disable_r(&defaultReader);
+}
+
+/*!
+ * \brief mlsBarcodeReader_Close close Reader file descriptor
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_Close()
+{
+	return mlsBarcodeReader_Close_r(&defaultReader);
+}
+
+/*!
+ * \brief mlsBarcodeReader_Reopen closes then opens device
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_Reopen(char *name)
+{
+	return mlsBarcodeReader_Reopen_r(&defaultReader, name);
+}
+
+/*!
+ * \brief CountNAK count received NAK by cause, see strNAK()
+ */
+static void CountNAK(mlsBarcodeReader *reader, byte cause)
+{
+	switch (cause)
+	{
+		case NAK_RESEND:
+			COUNTER_ADD(reader, nakResend, 1);
+			break;
+		case NAK_BAD_CONTEXT:
+			COUNTER_ADD(reader, nakBadContext, 1);
+			break;
+		case NAK_DENIED:
+			COUNTER_ADD(reader, nakDenied, 1);
+			break;
+		case NAK_CANCEL:
+			COUNTER_ADD(reader, nakCancel, 1);
+			break;
+		default:
+			COUNTER_ADD(reader, nakOther, 1);
+			break;
+	}
+}
+
+/*!
+ * \brief strNAK generate NAK message based on code
+ * \return NAK message string
+ */
+static char *strNAK(int code)
+{
+	char *msg = NULL;
+
+	switch (code) {
+		case NAK_RESEND:
+			msg = "RESEND";
+			break;
+
+		case NAK_CANCEL:
+			msg = "CANCEL";
+			break;
+
+		case NAK_DENIED:
+			msg = "DENIED";
+			break;
+
+		case NAK_BAD_CONTEXT:
+			msg = "NAK_BAD_CONTEXT";
+			break;
+
+		default:
+			break;
+	}
+
+	return msg;
+}
 
 /*!
- * \brief IsLastPackage check package's type
+ * \brief ParseInput handle complete packages in rxBuff until a barcode is complete
+ * or a command reply is received. Incomplete package is kept until the rest arrives.
  * \return
- * - TRUE: Is last package in multiple packages stream
- * - FALSE: Is intermediate package in multiple packages stream
+ * - PKG_DECODE: barcode is complete in decodeBuff
+ * - PKG_REPLY: ACK/NAK received, see lastReply
+ * - PKG_DROPPED: barcode was complete but filtered out
+ * - PKG_NONE: no more complete package in rxBuff
  */
-static int IsContinue(byte *pkg)
+static int ParseInput(mlsBarcodeReader *reader)
 {
-	return (STAT_CONTINUATION & pkg[INDEX_STAT]);
+	ssiFrame frames[PARSE_BATCH_FRAMES];
+	int ret = PKG_NONE;
+	int count = 0;
+	int consumed = 0;
+	int offset = 0;
+	int end = 0;
+	byte *pkg = NULL;
+
+	do
+	{
+		count = ssiCodec_Split(&reader->rxBuff[offset], reader->rxLen - offset, frames, PARSE_BATCH_FRAMES,
+				&consumed);
+
+		end = 0;
+		for (int i = 0; (i < count) && (PKG_NONE == ret); i++)
+		{
+			pkg = &reader->rxBuff[offset + frames[i].offset];
+			COUNTER_ADD(reader, resyncBytes, frames[i].skipped);
+
+			if (frames[i].isChecksumOK)
+			{
+				COUNTER_ADD(reader, framesRx, 1);
+				mlsBarcodeLog_Event(reader, MLS_EVENT_RX, pkg, &reader->rxTime);
+				if (pkg[INDEX_STAT] & STAT_RETRANS)
+				{
+					COUNTER_ADD(reader, retransRx, 1);
+				}
+				ret = HandlePackage(reader, pkg);
+			}
+			else
+			{
+				byte cause = NAK_RESEND;
+
+				COUNTER_ADD(reader, checksumErrors, 1);
+				mlsBarcodeLog_Event(reader, MLS_EVENT_CKSUM, pkg, &reader->rxTime);
+				LOG_ERROR("%s: checksum ERROR", __func__);
+
+				// Ask scanner to send it again; its resend is not a duplicate
+				if (EXIT_SUCCESS == WriteSSI(reader, SSI_CMD_NAK, &cause, 1))
+				{
+					COUNTER_ADD(reader, nakTx, 1);
+				}
+				reader->lastRxKey = 0;
+			}
+			end = frames[i].offset + frames[i].size;
+
+			// Arrival of following bytes is only known to read granularity
+			reader->rxStartTime = reader->rxTime;
+		}
+
+		if (PKG_NONE == ret)
+		{
+			// Bytes dropped after the last frame are handled too
+			COUNTER_ADD(reader, resyncBytes, consumed - end);
+			end = consumed;
+		}
+		offset += end;
+	} while ( (PKG_NONE == ret) && (PARSE_BATCH_FRAMES == count) );
+
+	reader->rxLen -= offset;
+	memmove(reader->rxBuff, &reader->rxBuff[offset], reader->rxLen);
+
+	return ret;
+}
+
+/*!
+ * \brief HandlePackage ACK scanner messages and reassemble decode data
+ * \return
+ * - PKG_DECODE: last package of a barcode, barcode is complete in decodeBuff
+ * - PKG_REPLY: ACK/NAK of a host command
+ * - PKG_DROPPED: last package of a filtered barcode
+ * - PKG_NONE: otherwise
+ */
+static int HandlePackage(mlsBarcodeReader *reader, byte *pkg)
+{
+	int partLen = 0;
+
+	if (IS_LOG_DEBUG())
+	{
+		DisplayPkg(pkg);
+	}
+
+	// Resend of a package already handled: our ACK was lost, ACK it again only
+	if (IsDuplicate(reader, pkg))
+	{
+		COUNTER_ADD(reader, duplicatesRx, 1);
+		WriteSSI(reader, SSI_CMD_ACK, NULL, 0);
+		return PKG_NONE;
+	}
+
+	switch (pkg[INDEX_OPCODE])
+	{
+		case SSI_DEC_DATA:
+			WriteSSI(reader, SSI_CMD_ACK, NULL, 0);
+			clock_gettime(CLOCK_MONOTONIC, &reader->ackTime);
+
+			if (0 == reader->decodePackets)
+			{
+				reader->decodeType = pkg[INDEX_BARCODETYPE];
+				reader->decodeTime = reader->rxTime;
+				reader->decodeStartTime = reader->rxStartTime;
+				reader->decodeTruncated = 0;
+			}
+			reader->decodePackets++;
+
+			// Payload follows 1 byte of barcode type
+			AppendDecode(reader, &pkg[INDEX_BARCODETYPE + 1], PKG_LEN(pkg) - SSI_HEADER_LEN - 1);
+
+			if (SSI_IS_CONTINUE(pkg))
+			{
+				break;
+			}
+
+			// Filtered symbology: already ACKed, drop it here
+			if (reader->symbologyDeny[reader->decodeType / 32] & (1U << (reader->decodeType % 32)))
+			{
+				LOG_DEBUG("symbology 0x%02x dropped", reader->decodeType);
+				reader->decodeLen = 0;
+				reader->decodePackets = 0;
+				return PKG_DROPPED;
+			}
+
+			if (mlsBarcodeDedup_IsRepeat(reader, (NULL != reader->decodeDest) ? reader->decodeDest : reader->decodeBuff,
+					reader->decodeLen))
+			{
+				COUNTER_ADD(reader, repeatScans, 1);
+				reader->decodeLen = 0;
+				reader->decodePackets = 0;
+				return PKG_DROPPED;
+			}
+
+			if (NULL == reader->decodeDest)
+			{
+				reader->decodeBuff[reader->decodeLen] = '\0';
+			}
+			return PKG_DECODE;
+
+		case SSI_EVENT:
+			WriteSSI(reader, SSI_CMD_ACK, NULL, 0);
+			break;
+
+		case SSI_PARAM_SEND:
+			// Reply to SSI_PARAM_REQUEST
+			WriteSSI(reader, SSI_CMD_ACK, NULL, 0);
+
+			partLen = PKG_LEN(pkg) - SSI_HEADER_LEN;
+			if (partLen > PARAM_REPLY_LEN - reader->paramReplyLen)
+			{
+				partLen = PARAM_REPLY_LEN - reader->paramReplyLen;
+			}
+			memcpy(&reader->paramReply[reader->paramReplyLen], &pkg[SSI_HEADER_LEN], partLen);
+			reader->paramReplyLen += partLen;
+
+			if (SSI_IS_CONTINUE(pkg))
+			{
+				break;
+			}
+			return PKG_PARAM;
+
+		case SSI_CMD_ACK:
+		case SSI_CMD_NAK:
+			reader->lastReply = pkg[INDEX_OPCODE];
+			reader->lastCause = (PKG_LEN(pkg) > INDEX_CAUSE) ? pkg[INDEX_CAUSE] : 0;
+			if (SSI_CMD_NAK == reader->lastReply)
+			{
+				CountNAK(reader, reader->lastCause);
+			}
+			return PKG_REPLY;
+
+		default:
+			break;
+	}
+
+	return PKG_NONE;
+}
+
+/*!
+ * \brief AppendDecode append payload of a DEC_DATA package to the barcode being reassembled.
+ * Bytes beyond the destination are counted in decodeTruncated instead of being written.
+ */
+static void AppendDecode(mlsBarcodeReader *reader, const byte *data, int len)
+{
+	char *dest = reader->decodeDest;
+	int room = reader->decodeDestLen - reader->decodeLen;
+
+	if (NULL == dest)
+	{
+		// Keep 1 byte for null terminator
+		dest = reader->decodeBuff;
+		room = RECV_BUFF_LEN - 1 - reader->decodeLen;
+	}
+
+	if (len > room)
+	{
+		reader->decodeTruncated += len - room;
+		len = room;
+	}
+
+	if (len > 0)
+	{
+		memcpy(&dest[reader->decodeLen], data, len);
+		reader->decodeLen += len;
+	}
+}
+
+/*!
+ * \brief SetDecodeDest select where barcode is reassembled, moving bytes already received.
+ * \param dest caller buffer, NULL for decodeBuff
+ */
+static void SetDecodeDest(mlsBarcodeReader *reader, char *dest, int destLen)
+{
+	char *from = (NULL != reader->decodeDest) ? reader->decodeDest : reader->decodeBuff;
+	int len = reader->decodeLen;
+
+	reader->decodeDest = dest;
+	reader->decodeDestLen = (0 < destLen) ? destLen : 0;
+	reader->decodeLen = 0;
+
+	if ( (0 < len) && (from != dest) )
+	{
+		AppendDecode(reader, (const byte *) from, len);
+	}
+	else
+	{
+		reader->decodeLen = len;
+	}
+}
+
+/*!
+ * \brief DispatchDecode pass barcode in decodeBuff to decode queue and reader callback, then release it
+ */
+static void DispatchDecode(mlsBarcodeReader *reader)
+{
+	mlsBarcodeLatency_Record(reader);
+
+	if (NULL != reader->queue)
+	{
+		if ( (mlsBarcodeRing_Push(reader->queue, reader->decodeBuff, reader->decodeLen, reader->decodeType,
+				&reader->rxTime)) && (0 == COUNTER_ADD(reader, queueDrops, 1)) )
+		{
+			// First drop only, later ones are counted
+			LOG_WARNING("%s: decode queue full, barcode dropped", reader->name);
+		}
+	}
+
+	if (reader->decodeTruncated)
+	{
+		LOG_ERROR("%s: barcode truncated, %u byte(s) dropped", reader->name, reader->decodeTruncated);
+	}
+
+	if (NULL != reader->callback)
+	{
+		reader->callback(reader, reader->decodeBuff, reader->decodeLen, &reader->rxTime, reader->userData);
+	}
+	else if (NULL == reader->queue)
+	{
+		// Completed while a command waited for its reply and already ACKed: keep it for the next read
+		KeepPendingDecode(reader);
+	}
+	reader->decodeLen = 0;
+	reader->decodePackets = 0;
 }
 
 /*!
@@ -546,214 +1424,491 @@ static int IsContinue(byte *pkg)
  */
 static void DisplayPkg(byte *pkg)
 {
+	static const char hex[] = "0123456789abcdef";
+	char line[3 * (MAX_PKG_LEN + SSI_CKSUM_LEN) + 1];
+	int len = 0;
+
 	if (NULL != pkg)
 	{
-		for (int i = 0; i < PKG_LEN(pkg) + 2; i++)
+		// Whole package in one message
+		for (int i = 0; i < SSI_FRAME_LEN(pkg); i++)
 		{
-			printf("0x%x ", pkg[i]);
+			line[len++] = hex[pkg[i] >> 4];
+			line[len++] = hex[pkg[i] & 0x0F];
+			line[len++] = ' ';
 		}
-		printf("\n");
+		line[len] = '\0';
+		LOG_DEBUG("%s", line);
 	}
 }
 
 /*!
- * \brief ConfigSSI send parameters to configure scanner
+ * \brief ConfigSSI send parameters of reader profile which differ from scanner values.
+ * Permanent profile matching the device cache is not sent at all. The cache holds values
+ * read from the scanner; temporary profiles are never cached, they are lost on power cycle.
  * \return
  * - EXIT_SUCCESS: Success
  * - EXIT_FAILURE: Fail
  */
-static int ConfigSSI(int fd)
+static int ConfigSSI(mlsBarcodeReader *reader)
 {
-	const char *debugLevel = getenv("STYL_DEBUG");
 	int ret = EXIT_SUCCESS;
-	byte param[12] = { 0x01,
-		PARAM_B_DEC_FORMAT, ENABLE,
-		PARAM_B_SW_ACK, ENABLE,
-		PARAM_B_SCAN_PARAM, DISABLE,	// Disable to avoid accidental changes param from scanning
-		PARAM_TRIGGER_MODE, PARAM_TRIGGER_PRESENT,
-		PARAM_INDEX_F0,	PARAM_B_DEC_EVENT, ENABLE
-	};
+	unsigned int count = 0;
+	const mlsBarcodeParam *profile = mlsBarcodeParam_GetProfile(reader, &count);
+	mlsBarcodeParam current[MAX_PROFILE_PARAMS];
+	mlsBarcodeParam changes[MAX_PROFILE_PARAMS];
+	int currentCount = -1;
+	unsigned int changeCount = 0;
+	int isFromDevice = FALSE;
+	byte param[MAX_PKG_LEN];
+	byte sendBuff[MAX_PKG_LEN];
+	int paramLen = 0;
+
+	// Temporary values are lost on power cycle, only permanent ones can be trusted from cache
+	if (reader->isParamPermanent)
+	{
+		currentCount = mlsBarcodeParam_LoadCache(reader, current, MAX_PROFILE_PARAMS);
+	}
+
+	pthread_mutex_lock(&reader->ioLock);
+	changeCount = DiffParams(profile, count, current, currentCount, changes);
+
+	// Cache miss or mismatch: ask scanner for its actual values
+	if (0 != changeCount)
+	{
+		currentCount = RequestParams(reader, profile, count, current);
+		changeCount = DiffParams(profile, count, current, currentCount, changes);
+		isFromDevice = (0 <= currentCount);
+	}
 
-	if (NULL != debugLevel) {
-		printf("Configure SSI parameters...");
+	if (0 == changeCount)
+	{
+		pthread_mutex_unlock(&reader->ioLock);
+		LOG_DEBUG("Configure SSI parameters: up to date");
+		goto SAVE;
 	}
 
-	ret = WriteSSI(fd, SSI_PARAM_SEND, param, ( sizeof(param) / sizeof(*param) ) );
+	param[0] = PARAM_BEEP_DEFAULT;
+	paramLen = 1 + mlsBarcodeParam_Encode(changes, changeCount, &param[1], TRUE);
+	ssiCodec_Encode(sendBuff, SSI_PARAM_SEND, SSI_HOST, (reader->isParamPermanent) ? STAT_CHANGETYPE : SSI_DEFAULT_STATUS,
+			param, paramLen);
+
+	if (WriteTx(reader, sendBuff, SSI_FRAME_LEN(sendBuff), 1))
+	{
+		pthread_mutex_unlock(&reader->ioLock);
+		LOG_ERROR("%s", __func__);
+		ret = EXIT_FAILURE;
+		goto EXIT;
+	}
 
+	// Consume the reply so it is not taken for the ACK of a later command.
+	// Scanner may not ACK when software ACK was disabled before, not an error.
+	ret = CheckACK(reader);
+	ret = Retransmit(reader, sendBuff, ret, reader->lastCause);
 	if (ret)
 	{
-		printf("ERROR: %s\n", __func__);
+		pthread_mutex_unlock(&reader->ioLock);
+		LOG_WARNING("Configure SSI parameters: no ACK");
+		ret = EXIT_SUCCESS;
 		goto EXIT;
 	}
-	else
+	LOG_DEBUG("Configure SSI parameters: %u parameter(s) sent", changeCount);
+
+	// Scanner may ACK and still ignore some values: cache only what it reports back
+	if (reader->isParamPermanent)
 	{
-		if (NULL != debugLevel) {
-			printf("OK\n");
+		currentCount = RequestParams(reader, profile, count, current);
+		isFromDevice = (0 <= currentCount);
+		changeCount = DiffParams(profile, count, current, currentCount, changes);
+		if ( (isFromDevice) && (0 != changeCount) )
+		{
+			LOG_WARNING("Configure SSI parameters: %u parameter(s) not applied", changeCount);
 		}
 	}
+	pthread_mutex_unlock(&reader->ioLock);
+
+SAVE:
+	if ( (reader->isParamPermanent) && (isFromDevice) )
+	{
+		mlsBarcodeParam_SaveCache(reader, current, (unsigned int) currentCount);
+	}
 
 EXIT:
 	return ret;
 }
 
 /*!
- * \brief WriteSSI write formatted package and check ACK to/from scanner via file descriptor
+ * \brief DiffParams collect profile parameters whose current value differs or is unknown
+ * \return number of parameters in changes
+ */
+static unsigned int DiffParams(const mlsBarcodeParam *profile, unsigned int count,
+		const mlsBarcodeParam *current, int currentCount, mlsBarcodeParam *changes)
+{
+	const mlsBarcodeParam *found = NULL;
+	unsigned int changeCount = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		found = (0 < currentCount) ? mlsBarcodeParam_Find(current, currentCount, profile[i].number) : NULL;
+		if ( (NULL == found) || (found->value != profile[i].value) )
+		{
+			changes[changeCount++] = profile[i];
+		}
+	}
+
+	return changeCount;
+}
+
+/*!
+ * \brief RequestParams read current values of profile parameters from scanner
+ * \return
+ * - number of parameters in current
+ * - -1: scanner did not reply, values are unknown
+ */
+static int RequestParams(mlsBarcodeReader *reader, const mlsBarcodeParam *profile, unsigned int count,
+		mlsBarcodeParam *current)
+{
+	byte param[MAX_PKG_LEN];
+	int paramLen = mlsBarcodeParam_Encode(profile, count, param, FALSE);
+	int ret = PKG_NONE;
+
+	reader->paramReplyLen = 0;
+	if (WriteSSI(reader, SSI_PARAM_REQUEST, param, paramLen))
+	{
+		return -1;
+	}
+
+	// Scanner answers with PARAM_SEND, or NAK if a parameter is not supported
+	ret = ReadSSI(reader, PKG_PARAM | PKG_REPLY, reader->commandTimeoutMs ? reader->commandTimeoutMs : ACK_TIMEOUT_MSEC);
+	if (PKG_PARAM != ret)
+	{
+		if (PKG_NONE == ret)
+		{
+			COUNTER_ADD(reader, commandTimeouts, 1);
+			mlsBarcodeLog_Event(reader, MLS_EVENT_TIMEOUT, NULL, NULL);
+		}
+		return -1;
+	}
+
+	// Reply data starts with beep code
+	return mlsBarcodeParam_Decode(&reader->paramReply[1], reader->paramReplyLen - 1,
+			current, MAX_PROFILE_PARAMS);
+}
+
+/*!
+ * \brief WriteSSI write formatted package to scanner via file descriptor.
+ * Parameterless commands use prebuilt packages, others are built on the stack.
+ * Input queue is left untouched: bytes already received belong to scanner messages.
  * \return
  * - EXIT_SUCCESS: Success
  * - EXIT_FAILURE: Fail
  */
-static int WriteSSI(int fd, byte opcode, byte *param, byte paramLen)
+static int WriteSSI(mlsBarcodeReader *reader, byte opcode, byte *param, byte paramLen)
 {
-	int ret = EXIT_SUCCESS;
-	byte *sendBuff = malloc( (SSI_HEADER_LEN + paramLen) * sizeof(byte) );
+	byte sendBuff[MAX_PKG_LEN];
+	const byte *pkg = NULL;
 
-	// Flush old input queue
-	tcflush(fd, TCIFLUSH);
+	assert(paramLen <= UINT8_MAX - SSI_HEADER_LEN);
+
+	if ( (NULL == param) || (0 == paramLen) )
+	{
+		pkg = GetCommandPkg(opcode);
+	}
+
+	if (NULL == pkg)
+	{
+		ssiCodec_Encode(sendBuff, opcode, SSI_HOST, SSI_DEFAULT_STATUS, param, paramLen);
+		pkg = sendBuff;
+	}
+
+	return WriteTx(reader, pkg, SSI_FRAME_LEN(pkg), 1);
+}
+
+/*!
+ * \brief WriteTx write packed packages to scanner and count them
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int WriteTx(mlsBarcodeReader *reader, const byte *buff, int len, unsigned int frames)
+{
+	if (write(reader->fd, buff, len) != len)
+	{
+		LOG_ERRNO("write");
+		return EXIT_FAILURE;
+	}
+
+	COUNTER_ADD(reader, framesTx, frames);
+	COUNTER_ADD(reader, bytesTx, len);
+	if (NULL != reader->capture)
+	{
+		mlsBarcodeCapture_Write(reader, CAPTURE_TX, buff, len, NULL);
+	}
+
+	for (int offset = 0; offset < len; offset += SSI_FRAME_LEN(&buff[offset]))
+	{
+		mlsBarcodeLog_Event(reader, MLS_EVENT_TX, &buff[offset], NULL);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief GetCommandPkg prebuilt package of parameterless command
+ * \return
+ * - pointer to package
+ * - NULL: no prebuilt package for this opcode
+ */
+static const byte *GetCommandPkg(byte opcode)
+{
+	switch (opcode)
+	{
+		case SSI_CMD_ACK:
+			return ackPkg;
+		case SSI_START_SESSION:
+			return startSessionPkg;
+		case SSI_STOP_SESSION:
+			return stopSessionPkg;
+		case SSI_SCAN_ENABLE:
+			return scanEnablePkg;
+		case SSI_SCAN_DISABLE:
+			return scanDisablePkg;
+		case SSI_FLUSH_QUEUE:
+			return flushQueuePkg;
+		default:
+			return NULL;
+	}
+}
+
+/*!
+ * \brief ReadSSI receive and parse packages from scanner until a wanted one is
+ * complete or timeout expires. tty settings are not touched, input is read in chunks.
+ * A barcode completed while waiting for something else goes to reader callback.
+ * \param wanted mask of PKG_DECODE/PKG_REPLY
+ * \param timeoutMs maximum wait time in milliseconds, -1 to wait forever
+ * \return
+ * - PKG_DECODE/PKG_REPLY: what has been received
+ * - PKG_NONE: timeout
+ * - -1: read error
+ */
+static int ReadSSI(mlsBarcodeReader *reader, const int wanted, const int timeoutMs)
+{
+	int ret = PKG_NONE;
+	int waitMs = timeoutMs;
+	const int64_t deadline = mlsBarcode_GetTimeMs() + timeoutMs;
+
+	while (TRUE)
+	{
+		// Packages left from previous read come first
+		while (PKG_NONE != (ret = ParseInput(reader)))
+		{
+			if (ret & wanted)
+			{
+				return ret;
+			}
+			if (PKG_DECODE == ret)
+			{
+				DispatchDecode(reader);
+			}
+		}
+
+		ret = WaitInput(reader->fd, waitMs);
+		if (0 > ret)
+		{
+			return -1;
+		}
+
+		if ( (0 < ret) && (0 > ReadInput(reader)) )
+		{
+			return -1;
+		}
+
+		// Nothing received (or interrupted): stop only once deadline has passed
+		if (0 <= timeoutMs)
+		{
+			waitMs = (int) (deadline - mlsBarcode_GetTimeMs());
+			if ( (0 == ret) && (0 >= waitMs) )
+			{
+				return PKG_NONE;
+			}
+			if (waitMs < 0)
+			{
+				waitMs = 0;
+			}
+		}
+	}
+}
+
+/*!
+ * \brief ReadInput append available bytes from scanner to rxBuff
+ * \return
+ * - number of read bytes, 0 if nothing available
+ * - -1: read error or device hang up
+ */
+static int ReadInput(mlsBarcodeReader *reader)
+{
+	ssize_t len = 0;
+
+	// Full of frames a command left unparsed while waiting for its reply:
+	// read(fd, buf, 0) would return 0 and look like a hang up
+	if (RX_BUFF_LEN <= reader->rxLen)
+	{
+		return 0;
+	}
+
+	do
+	{
+		len = read(reader->fd, &reader->rxBuff[reader->rxLen], RX_BUFF_LEN - reader->rxLen);
+	} while ( (0 > len) && (EINTR == errno) );
+
+	if (0 > len)
+	{
+		if ( (EAGAIN == errno) || (EWOULDBLOCK == errno) )
+		{
+			return 0;
+		}
+		LOG_ERRNO(__func__);
+		return -1;
+	}
+	else if (0 == len)
+	{
+		// Device hang up
+		COUNTER_ADD(reader, hangups, 1);
+		mlsBarcodeLog_Event(reader, MLS_EVENT_HANGUP, NULL, NULL);
+		return -1;
+	}
 
-	PreparePkg(sendBuff, opcode, param, paramLen);
-	if ( write(fd, sendBuff, PKG_LEN(sendBuff) + 2) <= 0)
+	COUNTER_ADD(reader, bytesRx, len);
+	clock_gettime(CLOCK_MONOTONIC, &reader->rxTime);
+	if (NULL != reader->capture)
 	{
-		perror("write");
-		ret = EXIT_FAILURE;
-		goto EXIT;
+		mlsBarcodeCapture_Write(reader, CAPTURE_RX, &reader->rxBuff[reader->rxLen], (int) len, &reader->rxTime);
+	}
+	if (0 == reader->rxLen)
+	{
+		reader->rxStartTime = reader->rxTime;
 	}
+	reader->rxLen += (int) len;
 
-EXIT:
-	free(sendBuff);
-	return ret;
+	return (int) len;
 }
 
 /*!
- * \brief ReadSSI read formatted package and response ACK from/to scanner via file descriptor
- * \return number of read bytes
+ * \brief WaitInput wait until scanner has input
+ * \return
+ * - 1: input available
+ * - 0: timeout
+ * - -1: Fail
  */
-static int ReadSSI(int fd, byte *buff, const int timeout)
+static int WaitInput(int fd, const int timeoutMs)
 {
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
 	int ret = 0;
-	int lastIndex = 0;
-	int oldVTIME = 0;
-	int oldVMIN = 0;
-	int readRequest = 0;
-	struct termios devConf;
-	byte recvBuff[MAX_PKG_LEN];
-	char *debugLevel = getenv("STYL_DEBUG");
-
-	// Backup old value
-	tcgetattr(fd, &devConf);
-	oldVTIME = devConf.c_cc[VTIME];
-	oldVMIN = devConf.c_cc[VMIN];
 
-	do
+	ret = poll(&pfd, 1, timeoutMs);
+	if (0 > ret)
 	{
-		// Read 1 first byte for length
-		// Setup timeout read
-		readRequest = 1;
-		devConf.c_cc[VTIME] = timeout;
-		devConf.c_cc[VMIN] = 0;
-		tcsetattr(fd, TCSANOW, &devConf);
-		ret += (int) read(fd, &recvBuff[INDEX_LEN], readRequest);
-		if (ret <= 0)
-		{
-			goto EXIT;
-		}
-
-		readRequest = recvBuff[INDEX_LEN] + 2 - 1; 	// read package + cksum - first_byte
-		if (NULL != debugLevel)
+		if (EINTR == errno)
 		{
-			printf("read request = %d\n", readRequest);
+			return 0;
 		}
+		LOG_ERRNO(__func__);
+		return -1;
+	}
 
-		// Change reading condition to ensure read enough bytes
-		devConf.c_cc[VTIME] = 0;
-		devConf.c_cc[VMIN] = readRequest;
-		tcsetattr(fd, TCSANOW, &devConf);
+	return (ret > 0) ? 1 : 0;
+}
 
-		// Get n next bytes (n = length + 2 - 1), 2 last bytes are cksum
-		ret += (int) read(fd, &recvBuff[INDEX_LEN + 1], readRequest);
+/*!
+ * \brief mlsBarcode_GetTimeMs monotonic clock in milliseconds
+ */
+int64_t mlsBarcode_GetTimeMs(void)
+{
+	struct timespec now;
 
-		if ( (ret > 0) || (IsChecksumOK(recvBuff)) )
-		{
-			WriteSSI(fd, SSI_CMD_ACK, NULL, 0);
-			memcpy(&buff[lastIndex], recvBuff, PKG_LEN(recvBuff) + 2);
-			lastIndex += PKG_LEN(recvBuff) + 2;
-		}
-		else
-		{
-			printf("%s: ERROR", __func__);
-			ret = -1;
-			goto EXIT;
-		}
-	} while (IsContinue(recvBuff));
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-EXIT:
-	// Return old value
-	devConf.c_cc[VTIME] = oldVTIME;
-	devConf.c_cc[VMIN] = oldVMIN;
-	tcsetattr(fd, TCSANOW, &devConf);
-	return ret;
+	return ( (int64_t) now.tv_sec * 1000 ) + ( now.tv_nsec / 1000000 );
 }
 
 /*!
- * \brief WriteSSI write formatted package to scanner via file descriptor
- * \return file descriptor
+ * \brief OpenTTY open scanner device and lock it for this reader
+ * \return
+ * - file descriptor: Success
+ * - -1: Fail, device missing or opened by another reader
  */
 static int OpenTTY(char *name)
 {
-	int fd = 0;
-	int lockfd = 0;
+	int fd = -1;
 
-	lockfd = open(LOCK_SCANNER_PATH, O_RDWR);
-
-	if (lockfd > 0) {
-		printf("ERROR: device is busy\n");
+	fd = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (0 > fd)
+	{
+		LOG_ERRNO(__func__);
 		return -1;
 	}
-	else {
-		close(lockfd);
-	}
-
-	LockScanner(fd);
 
-	fd = open(name, O_RDWR);
-	if (fd <= 0)
+	if (LockScanner(fd, name))
 	{
-		perror(__func__);
+		close(fd);
+		return -1;
 	}
 
 	return fd;
 }
 
-static int LockScanner(int fd)
+/*!
+ * \brief LockScanner take exclusive lock of one device. Both locks belong to the open
+ * descriptor, so they go away with it, also when the process dies.
+ * - flock(): other readers of any process fail with "device is busy"
+ * - TIOCEXCL: other non-root open() of the tty fail with EBUSY
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: device is locked by another descriptor
+ */
+static int LockScanner(int fd, const char *name)
 {
-	int lockfd = 0;
-
-	lockfd = open(LOCK_SCANNER_PATH, O_CREAT | O_WRONLY, S_IWUSR | S_IRUSR);
-
-	if (lockfd <= 0) {
-		perror("Failed to lock scanner: ");
+	if (flock(fd, LOCK_EX | LOCK_NB))
+	{
+		if (EWOULDBLOCK == errno)
+		{
+			LOG_ERROR("%s: device is busy", name);
+		}
+		else
+		{
+			LOG_ERRNO(__func__);
+		}
 		return EXIT_FAILURE;
 	}
 
-	write(lockfd, &fd, sizeof(fd));
-
-	close(lockfd);
+	// Not a tty (e.g. a test FIFO): flock alone is enough
+	if (ioctl(fd, TIOCEXCL))
+	{
+		LOG_DEBUG("%s: TIOCEXCL: %s", name, strerror(errno));
+	}
 
 	return EXIT_SUCCESS;
 }
 
-static void UnlockScanner(void)
+/*!
+ * \brief UnlockScanner let other descriptors open the device again, before it is closed
+ */
+static void UnlockScanner(int fd)
 {
-	remove(LOCK_SCANNER_PATH);
+	// Exclusive mode belongs to the tty and may outlive this descriptor
+	ioctl(fd, TIOCNXCL);
+	flock(fd, LOCK_UN);
 }
 
 /*!
- * \brief WriteSSI write formatted package to scanner via file descriptor
+ * \brief ConfigTTY configure tty line of scanner according to selected profile, at 9600 baud
  * \return
  * - EXIT_SUCCESS: Success
  * - EXIT_FAILURE: Fail
  */
-static int ConfigTTY(int fd)
+static int ConfigTTY(mlsBarcodeReader *reader)
 {
+	const int fd = reader->fd;
 	int ret = EXIT_SUCCESS;
 	int flags = 0;
 	struct termios devConf;
@@ -762,34 +1917,54 @@ static int ConfigTTY(int fd)
 	flags = fcntl(fd, F_GETFL);
 	if (0 > flags)
 	{
-		perror("F_GETFL");
+		LOG_ERRNO("F_GETFL");
 		ret = EXIT_FAILURE;
 		goto EXIT;
 	}
-	flags |= (O_FSYNC);
+	if (MLS_TTY_PROFILE_LOW_LATENCY == reader->ttyProfile)
+	{
+		// Writes are small and paced by ACKs, no need to sync them
+		flags &= ~(O_FSYNC);
+	}
+	else
+	{
+		flags |= (O_FSYNC);
+	}
 	flags &= ~(O_NDELAY | O_ASYNC);
 
 	ret = fcntl(fd, F_SETFL, flags);
 	if (ret)
 	{
-		perror("F_SETFL");
+		LOG_ERRNO("F_SETFL");
 		ret = EXIT_FAILURE;
 		goto EXIT;
 	}
 
 	// Configure tty dev
-	devConf.c_cflag = (CS8 | CLOCAL | CREAD);
-	devConf.c_iflag = 0;
-	devConf.c_oflag = 0;
-	devConf.c_lflag = 0;
-	devConf.c_cc[VMIN] = 0;
-	devConf.c_cc[VTIME] = TIMEOUT_MSEC;	// read non-blocking flush dump data. See blocking read timeout later
+	if (MLS_TTY_PROFILE_LOW_LATENCY == reader->ttyProfile)
+	{
+		memset(&devConf, 0, sizeof(devConf));
+		cfmakeraw(&devConf);
+		devConf.c_cflag |= (CLOCAL | CREAD);
+		devConf.c_cflag &= ~(CSTOPB | CRTSCTS);
+		SetLowLatency(fd);
+	}
+	else
+	{
+		devConf.c_cflag = (CS8 | CLOCAL | CREAD);
+		devConf.c_iflag = 0;
+		devConf.c_oflag = 0;
+		devConf.c_lflag = 0;
+	}
+	// Reads are done only after poll() reports input, timeouts are handled by poll()
+	devConf.c_cc[VMIN] = 1;
+	devConf.c_cc[VTIME] = 0;
 
 	// Portability: Use cfsetspeed instead of CBAUD since c_cflag/CBAUD is not in POSIX
 	ret = cfsetspeed(&devConf, BAUDRATE);
 	if (ret)
 	{
-		perror("Set speed");
+		LOG_ERRNO("Set speed");
 		ret = EXIT_FAILURE;
 		goto EXIT;
 	}
@@ -797,7 +1972,7 @@ static int ConfigTTY(int fd)
 	ret = tcsetattr(fd, TCSANOW, &devConf);
 	if (ret)
 	{
-		perror("Set attribute");
+		LOG_ERRNO("Set attribute");
 		ret = EXIT_FAILURE;
 		goto EXIT;
 	}
@@ -807,38 +1982,180 @@ EXIT:
 }
 
 /*!
- * \brief ExtractBarcode extract barcode from formatted package
+ * \brief SetLowLatency ask serial driver to push received bytes without delay.
+ * Not supported by every driver (USB CDC, pty), failure is not an error.
  * \return
- * - barcode length: Success
- * - 0: Fail
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Not supported
  */
-static int ExtractBarcode(char *buff, byte *pkg, const int buffLength)
+static int SetLowLatency(int fd)
 {
-	char *barcodePtr = buff;
-	byte *pkgPtr = pkg;
-	int barcodeLength = 0;
-	int barcodePartLength = 0;
+#if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+	struct serial_struct serial;
 
-	if (NULL != pkgPtr)
+	if (0 == ioctl(fd, TIOCGSERIAL, &serial))
 	{
-		while (IsContinue(pkgPtr))
+		serial.flags |= ASYNC_LOW_LATENCY;
+		if (0 == ioctl(fd, TIOCSSERIAL, &serial))
 		{
-			barcodePartLength = PKG_LEN(pkgPtr) - SSI_HEADER_LEN - 1;
-			memcpy(barcodePtr, &pkgPtr[INDEX_BARCODETYPE + 1], barcodePartLength);
-			barcodeLength += barcodePartLength;	// 1 byte of barcode type
+			return EXIT_SUCCESS;
+		}
+	}
+#endif
+
+	LOG_DEBUG("%s: not supported by driver", __func__);
+
+	return EXIT_FAILURE;
+}
+
+/*!
+ * \brief SetSpeed change tty speed once pending output is sent
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int SetSpeed(int fd, speed_t speed)
+{
+	struct termios devConf;
+
+	if ( (tcgetattr(fd, &devConf)) || (cfsetspeed(&devConf, speed)) ||
+			(tcsetattr(fd, TCSADRAIN, &devConf)) )
+	{
+		LOG_ERRNO(__func__);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief GetBaudCode map baud rate to termios speed and SSI baud rate parameter value
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: unsupported baud rate
+ */
+static int GetBaudCode(unsigned int baudRate, speed_t *speed, byte *code)
+{
+	switch (baudRate)
+	{
+		case 9600:
+			*speed = B9600;
+			*code = PARAM_BAUD_9600;
+			break;
+		case 19200:
+			*speed = B19200;
+			*code = PARAM_BAUD_19200;
+			break;
+		case 38400:
+			*speed = B38400;
+			*code = PARAM_BAUD_38400;
+			break;
+		case 57600:
+			*speed = B57600;
+			*code = PARAM_BAUD_57600;
+			break;
+		case 115200:
+			*speed = B115200;
+			*code = PARAM_BAUD_115200;
+			break;
+		default:
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief NegotiateBaudRate switch scanner and host to requested baud rate.
+ * Scanner ACKs the (temporary) baud rate parameter at the old rate, then both
+ * sides switch and the change is verified by resending it at the new rate.
+ * If verification fails both sides fall back to 9600. A scanner silent at 9600
+ * is probed at reader->baudRate, where a previous open may have left it.
+ * \return
+ * - EXIT_SUCCESS: Success, link runs at reader->baudRate or fell back to 9600
+ * - EXIT_FAILURE: Fail, scanner answers neither at 9600 nor at reader->baudRate
+ */
+static int NegotiateBaudRate(mlsBarcodeReader *reader)
+{
+	speed_t speed = BAUDRATE;
+	byte param[3] = { PARAM_BEEP_NONE, PARAM_BAUD_RATE, PARAM_BAUD_9600 };
+	int ret = EXIT_SUCCESS;
+
+	if ( (0 == reader->baudRate) || (9600 == reader->baudRate) )
+	{
+		return EXIT_SUCCESS;
+	}
+
+	if (GetBaudCode(reader->baudRate, &speed, &param[2]))
+	{
+		LOG_ERROR("%s: unsupported baud rate %u", __func__, reader->baudRate);
+		return EXIT_FAILURE;
+	}
 
-			// Point to next pkg
-			barcodePtr += PKG_LEN(pkgPtr) + 2;
-			pkgPtr += PKG_LEN(pkgPtr) + 2;
+	ret = SendCommand(reader, SSI_PARAM_SEND, param, sizeof(param));
+	if (ENAK == ret)
+	{
+		// Scanner refused, link is still at 9600
+		LOG_WARNING("%s: scanner refused %u baud, keep 9600", __func__, reader->baudRate);
+		return EXIT_SUCCESS;
+	}
+	else if (EXIT_SUCCESS != ret)
+	{
+		// Scanner may still run at the rate of a previous open
+		SetSpeed(reader->fd, speed);
+		reader->rxLen = 0;
+		if (EXIT_SUCCESS == SendCommand(reader, SSI_PARAM_SEND, param, sizeof(param)))
+		{
+			LOG_INFO("%s: scanner already at %u baud", __func__, reader->baudRate);
+			return EXIT_SUCCESS;
 		}
 
-		// Get the last part of barcode
-		barcodePartLength = PKG_LEN(pkgPtr) - SSI_HEADER_LEN - 1;
-		memcpy(barcodePtr, &pkgPtr[INDEX_BARCODETYPE + 1], barcodePartLength);
-		barcodeLength += barcodePartLength;	// 1 byte of barcode type
+		LOG_ERROR("%s: no answer at 9600 nor %u baud", __func__, reader->baudRate);
+		SetSpeed(reader->fd, BAUDRATE);
+		reader->rxLen = 0;
+		return EXIT_FAILURE;
+	}
+
+	// Let scanner finish its switch before talking at the new rate
+	usleep(10000);
+	SetSpeed(reader->fd, speed);
+	if (EXIT_SUCCESS == SendCommand(reader, SSI_PARAM_SEND, param, sizeof(param)))
+	{
+		return EXIT_SUCCESS;
+	}
+
+	LOG_WARNING("%s: no answer at %u baud, fall back to 9600", __func__, reader->baudRate);
+	param[2] = PARAM_BAUD_9600;
+	SendCommand(reader, SSI_PARAM_SEND, param, sizeof(param));
+	usleep(10000);
+	SetSpeed(reader->fd, BAUDRATE);
+	reader->rxLen = 0;
+
+	return SendCommand(reader, SSI_PARAM_SEND, param, sizeof(param));
+}
+
+/*!
+ * \brief RestoreBaudRate put scanner back to 9600 before close, so that next open
+ * finds it at the default rate
+ */
+static void RestoreBaudRate(mlsBarcodeReader *reader)
+{
+	struct termios devConf;
+	byte param[3] = { PARAM_BEEP_NONE, PARAM_BAUD_RATE, PARAM_BAUD_9600 };
+
+	if ( (tcgetattr(reader->fd, &devConf)) || (BAUDRATE == cfgetospeed(&devConf)) )
+	{
+		return;
+	}
+
+	if (SendCommand(reader, SSI_PARAM_SEND, param, sizeof(param)))
+	{
+		LOG_WARNING("%s: scanner did not go back to 9600", __func__);
+		return;
 	}
 
-	return barcodeLength;
+	usleep(10000);
+	SetSpeed(reader->fd, BAUDRATE);
 }
 
 /*!
@@ -848,48 +2165,271 @@ static int ExtractBarcode(char *buff, byte *pkg, const int buffLength)
  * - EXIT_FAILURE: Fail		Unknown cause
  * - ENAK(3)	 : Fail		NAK
  */
-static int CheckACK(int fd)
+static int CheckACK(mlsBarcodeReader *reader)
 {
-	const char *debugLevel = getenv("STYL_DEBUG");
 	int ret = EXIT_SUCCESS;
-	byte recvBuff[MAX_PKG_LEN];
 
-	ret = ReadSSI(fd, recvBuff, 1);
-	if ( (ret > 0) && (SSI_CMD_ACK == recvBuff[INDEX_OPCODE]) )
+	ret = ReadSSI(reader, PKG_REPLY, reader->commandTimeoutMs ? reader->commandTimeoutMs : ACK_TIMEOUT_MSEC);
+	if ( (PKG_REPLY == ret) && (SSI_CMD_ACK == reader->lastReply) )
 	{
 		ret = EXIT_SUCCESS;
 	}
-	else if (SSI_CMD_NAK == recvBuff[INDEX_OPCODE])
+	else if (PKG_REPLY == ret)
 	{
 		ret = ENAK;
-		if (NULL != debugLevel) {
-			printf(" %s ", strNAK(recvBuff[INDEX_CAUSE]));
-		}
+		LOG_DEBUG("NAK %s", strNAK(reader->lastCause));
 	}
 	else
 	{
+		COUNTER_ADD(reader, commandTimeouts, 1);
+		mlsBarcodeLog_Event(reader, MLS_EVENT_TIMEOUT, NULL, NULL);
 		ret = EXIT_FAILURE;
 	}
 
 	return ret;
 }
 
+/*!
+ * \brief SendCommand write command package and wait for its ACK
+ * \return
+ * - EXIT_SUCCESS: Success	ACK
+ * - EXIT_FAILURE: Fail		write error or no reply
+ * - ENAK		 : Fail		NAK
+ */
+static int SendCommand(mlsBarcodeReader *reader, byte opcode, byte *param, byte paramLen)
+{
+	byte pkg[MAX_PKG_LEN];
+	int ret = EXIT_SUCCESS;
+
+	assert(paramLen <= UINT8_MAX - SSI_HEADER_LEN);
+
+	// Own copy: a resend sets the retransmit bit
+	CopyCommandPkg(pkg, opcode, param, paramLen);
+
+	pthread_mutex_lock(&reader->ioLock);
+
+	ret = WriteTx(reader, pkg, SSI_FRAME_LEN(pkg), 1);
+	if (EXIT_SUCCESS == ret)
+	{
+		ret = CheckACK(reader);
+		ret = Retransmit(reader, pkg, ret, reader->lastCause);
+	}
+
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return ret;
+}
+
+/*!
+ * \brief Retransmit write a command package again with STAT_RETRANS set while its reply
+ * is NAK RESEND or missing, at most retryLimit times
+ * \param ret, cause result and NAK cause of the previous attempt
+ * \return same as CheckACK() for the last attempt
+ */
+static int Retransmit(mlsBarcodeReader *reader, byte *pkg, int ret, byte cause)
+{
+	for (int retry = 0; retry < reader->retryLimit; retry++)
+	{
+		if ( (EXIT_FAILURE != ret) && ( (ENAK != ret) || (NAK_RESEND != cause) ) )
+		{
+			break;
+		}
+
+		if (! (pkg[INDEX_STAT] & STAT_RETRANS))
+		{
+			ssiCodec_SetStatus(pkg, pkg[INDEX_STAT] | STAT_RETRANS);
+		}
+		if (WriteTx(reader, pkg, SSI_FRAME_LEN(pkg), 1))
+		{
+			return EXIT_FAILURE;
+		}
+		COUNTER_ADD(reader, retransTx, 1);
+
+		ret = CheckACK(reader);
+		cause = reader->lastCause;
+	}
+
+	return ret;
+}
+
+/*!
+ * \brief CopyCommandPkg build command package in pkg, from prebuilt ones when possible
+ */
+static void CopyCommandPkg(byte *pkg, byte opcode, const byte *param, byte paramLen)
+{
+	const byte *prebuilt = NULL;
+
+	if ( (NULL == param) || (0 == paramLen) )
+	{
+		prebuilt = GetCommandPkg(opcode);
+	}
+
+	if (NULL != prebuilt)
+	{
+		memcpy(pkg, prebuilt, CMD_PKG_LEN);
+	}
+	else
+	{
+		ssiCodec_Encode(pkg, opcode, SSI_HOST, SSI_DEFAULT_STATUS, param, paramLen);
+	}
+}
+
+/*!
+ * \brief IsDuplicate check whether a scanner package is the resend of the last one handled,
+ * which happens when the scanner did not get our ACK. Remembers non-duplicates.
+ * \return
+ * - TRUE: duplicate, already handled
+ * - FALSE: new package
+ */
+static int IsDuplicate(mlsBarcodeReader *reader, const byte *pkg)
+{
+	const byte len = PKG_LEN(pkg);
+	uint16_t checksum = SSI_FRAME_CKSUM(pkg);
+	uint32_t key = 0;
+
+	// Replies to host commands are never ACKed, so never resent
+	if ( (SSI_CMD_ACK == pkg[INDEX_OPCODE]) || (SSI_CMD_NAK == pkg[INDEX_OPCODE]) )
+	{
+		return FALSE;
+	}
+
+	// Checksum of the first transmission: retransmit bit adds 1 to the byte sum
+	if (pkg[INDEX_STAT] & STAT_RETRANS)
+	{
+		checksum += STAT_RETRANS;
+	}
+	key = ( (uint32_t) len << 24 ) | ( (uint32_t) pkg[INDEX_OPCODE] << 16 ) | checksum;
+
+	if ( (pkg[INDEX_STAT] & STAT_RETRANS) && (key == reader->lastRxKey) )
+	{
+		return TRUE;
+	}
+
+	reader->lastRxKey = key;
+	return FALSE;
+}
+
+/*!
+ * \brief SendBatch write all command packages with as few writes as possible,
+ * then wait for one reply per command, in order. Commands with NAK RESEND or no reply are
+ * then sent again one by one with the retransmit bit, after the rest of the batch ran.
+ * \return
+ * - EXIT_SUCCESS: every command ACKed
+ * - EXIT_FAILURE: at least one command failed, see commands[i].result
+ */
+static int SendBatch(mlsBarcodeReader *reader, mlsBarcodeCommand *commands, unsigned int count)
+{
+	byte txBuff[TX_BUFF_LEN];
+	const byte *pkg = NULL;
+	int txLen = 0;
+	unsigned int txFrames = 0;
+	int pkgLen = 0;
+	int ret = EXIT_SUCCESS;
+	unsigned int i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		commands[i].result = EXIT_FAILURE;
+		commands[i].cause = 0;
+	}
+
+	pthread_mutex_lock(&reader->ioLock);
+
+	for (i = 0; i < count; i++)
+	{
+		assert(commands[i].paramLen <= UINT8_MAX - SSI_HEADER_LEN);
+
+		if (TX_BUFF_LEN - txLen < MAX_PKG_LEN)
+		{
+			if (WriteTx(reader, txBuff, txLen, txFrames))
+			{
+				goto EXIT;
+			}
+			txLen = 0;
+			txFrames = 0;
+		}
+
+		pkg = ( (NULL == commands[i].param) || (0 == commands[i].paramLen) ) ?
+				GetCommandPkg(commands[i].opcode) : NULL;
+		if (NULL != pkg)
+		{
+			pkgLen = SSI_FRAME_LEN(pkg);
+			memcpy(&txBuff[txLen], pkg, pkgLen);
+		}
+		else
+		{
+			pkgLen = ssiCodec_Encode(&txBuff[txLen], commands[i].opcode, SSI_HOST, SSI_DEFAULT_STATUS,
+					commands[i].param, commands[i].paramLen);
+		}
+		txLen += pkgLen;
+		txFrames++;
+	}
+
+	if ( (0 < txLen) && (WriteTx(reader, txBuff, txLen, txFrames)) )
+	{
+		goto EXIT;
+	}
+
+	// Scanner replies in order. Replies carry no command id: after a lost one the
+	// following replies land on the command before theirs, and the last command
+	// seems unanswered. Stop at the first missing reply, later ones would only time out.
+	for (i = 0; i < count; i++)
+	{
+		commands[i].result = CheckACK(reader);
+		if (ENAK == commands[i].result)
+		{
+			commands[i].cause = reader->lastCause;
+		}
+		else if (EXIT_SUCCESS != commands[i].result)
+		{
+			break;
+		}
+	}
+
+	// Resend only commands with NAK RESEND or no reply, with the retransmit bit so that
+	// the scanner drops one it already ran. Later commands keep their result: they ran
+	// before the resend, which is the ordering limit of a batch.
+	for (i = 0; (i < count) && (0 < reader->retryLimit); i++)
+	{
+		if (EXIT_SUCCESS == commands[i].result)
+		{
+			continue;
+		}
+
+		CopyCommandPkg(txBuff, commands[i].opcode, commands[i].param, commands[i].paramLen);
+		commands[i].result = Retransmit(reader, txBuff, commands[i].result, commands[i].cause);
+		commands[i].cause = (ENAK == commands[i].result) ? reader->lastCause : 0;
+	}
+
+EXIT:
+	pthread_mutex_unlock(&reader->ioLock);
+
+	for (i = 0; i < count; i++)
+	{
+		if (EXIT_SUCCESS != commands[i].result)
+		{
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	return ret;
+}
+
 /*!
  * \brief HandleError prints error message and indicate next step
  */
 static void PrintError(int ret)
 {
-	printf("ERROR:");
 	switch (ret) {
 		case ENAK:
-			printf(" NAK\n");
+			LOG_ERROR("NAK");
 			break;
 		case ENODEC:
-			printf(" no decode event\n");
+			LOG_ERROR("no decode event");
 			break;
 			
 		default:
-			printf("\n");
+			LOG_ERROR("no reply");
 			break;
 	}
 }
@@ -24,6 +24,203 @@ extern "C"
 #include <stdio.h>
 #include <termios.h>
 #include <locale.h>
+#include <time.h>
+
+#define MLS_BARCODE_MAX_LEN		4000
+
+/*!
+ * \brief mlsBarcodeReader opaque reader context.
+ * Each context owns one scanner (descriptor, tty settings, receive buffers),
+ * so one process can drive several scanners at the same time.
+ * The functions without context argument work on a built-in default context.
+ */
+typedef struct mlsBarcodeReader mlsBarcodeReader;
+
+/*!
+ * \brief mlsBarcodeTTYProfile tty settings applied by mlsBarcodeReader_Open_r()
+ */
+typedef enum mlsBarcodeTTYProfile
+{
+	MLS_TTY_PROFILE_DEFAULT = 0,		// blocking, synchronous writes
+	MLS_TTY_PROFILE_LOW_LATENCY			// raw mode, no O_FSYNC, ASYNC_LOW_LATENCY if driver supports it
+} mlsBarcodeTTYProfile;
+
+#define MLS_BARCODE_ENAK		0xA0	// command result: scanner replied NAK
+#define MLS_BARCODE_MAX_RETRIES	10		// upper bound of mlsBarcodeReader_SetRetryLimit()
+
+// Symbology ids (SSI barcode type), see the decoder's SSI guide for the full list
+#define MLS_SYMBOLOGY_CODE39		0x01
+#define MLS_SYMBOLOGY_CODABAR		0x02
+#define MLS_SYMBOLOGY_CODE128		0x03
+#define MLS_SYMBOLOGY_ITF			0x06
+#define MLS_SYMBOLOGY_CODE93		0x07
+#define MLS_SYMBOLOGY_UPCA			0x08
+#define MLS_SYMBOLOGY_UPCE			0x09
+#define MLS_SYMBOLOGY_EAN8			0x0A
+#define MLS_SYMBOLOGY_EAN13			0x0B
+#define MLS_SYMBOLOGY_GS1_128		0x0F
+#define MLS_SYMBOLOGY_PDF417		0x11
+#define MLS_SYMBOLOGY_DATAMATRIX	0x1B
+#define MLS_SYMBOLOGY_QRCODE		0x1C
+#define MLS_SYMBOLOGY_AZTEC			0x2D
+#define MLS_SYMBOLOGY_COUNT			256
+
+/*!
+ * \brief mlsBarcodeCommand one SSI command of a batch, see mlsBarcodeReader_SendBatch()
+ */
+typedef struct mlsBarcodeCommand
+{
+	unsigned char opcode;				// SSI opcode
+	const unsigned char *param;			// parameters, NULL if none
+	unsigned char paramLen;				// parameters length in bytes
+	int result;							// out: EXIT_SUCCESS (ACK), MLS_BARCODE_ENAK or EXIT_FAILURE (no reply)
+	unsigned char cause;				// out: NAK cause when result is MLS_BARCODE_ENAK
+} mlsBarcodeCommand;
+
+/*!
+ * \brief mlsBarcodeParam one scanner parameter, see mlsBarcodeReader_SetParamProfile()
+ */
+typedef struct mlsBarcodeParam
+{
+	unsigned short number;				// parameter number, 0x100-0x3FF for 0xF0-0xF2 prefixed ones
+	unsigned char value;
+} mlsBarcodeParam;
+
+/*!
+ * \brief mlsBarcodeLogLevel library log levels, see mlsBarcodeLog_SetLevel()
+ */
+typedef enum mlsBarcodeLogLevel
+{
+	MLS_LOG_NONE = 0,
+	MLS_LOG_ERROR,
+	MLS_LOG_WARNING,
+	MLS_LOG_INFO,
+	MLS_LOG_DEBUG
+} mlsBarcodeLogLevel;
+
+/*!
+ * \brief mlsBarcodeLog_Callback log message handler
+ * \param message one line, without level prefix nor line feed, only valid during the call
+ */
+typedef void (*mlsBarcodeLog_Callback)(mlsBarcodeLogLevel level, const char *message, void *userData);
+
+// Protocol event types, see mlsBarcodeReader_GetEvents()
+#define MLS_EVENT_RX				1	// valid package received
+#define MLS_EVENT_TX				2	// package written
+#define MLS_EVENT_CKSUM				3	// package received with bad checksum
+#define MLS_EVENT_TIMEOUT			4	// no ACK/NAK for a command
+#define MLS_EVENT_HANGUP			5	// device hang up
+#define MLS_EVENT_LOG_LEN			128	// events kept per reader
+
+/*!
+ * \brief mlsBarcodeEvent one protocol event as kept in a reader event ring
+ */
+typedef struct mlsBarcodeEvent
+{
+	struct timespec timestamp;			// CLOCK_MONOTONIC
+	unsigned char type;					// MLS_EVENT_*
+	unsigned char opcode;				// SSI package fields, 0 if event has no package
+	unsigned char length;
+	unsigned char status;
+	unsigned char data;					// first data byte: NAK cause, barcode type...
+} mlsBarcodeEvent;
+
+/*!
+ * \brief mlsBarcodeLatencyStage intervals measured for every barcode, CLOCK_MONOTONIC based
+ */
+typedef enum mlsBarcodeLatencyStage
+{
+	MLS_LATENCY_WIRE = 0,				// first byte to last package received: transfer on the wire
+	MLS_LATENCY_ACK,					// last package received to ACK written
+	MLS_LATENCY_DELIVERY,				// last package received to barcode handed to application
+	MLS_LATENCY_TOTAL,					// first byte received to barcode handed to application
+	MLS_LATENCY_STAGES
+} mlsBarcodeLatencyStage;
+
+#define MLS_HISTOGRAM_BUCKETS		240
+
+/*!
+ * \brief mlsBarcodeHistogram log-linear histogram of durations in microseconds.
+ * Values below 16 us have their own bucket, above that every power of 2 is split in 8.
+ */
+typedef struct mlsBarcodeHistogram
+{
+	unsigned long long count;			// number of samples
+	unsigned long long sumUs;			// sum of samples
+	unsigned int minUs;
+	unsigned int maxUs;
+	unsigned int buckets[MLS_HISTOGRAM_BUCKETS];
+} mlsBarcodeHistogram;
+
+/*!
+ * \brief mlsBarcodeStats protocol counters of a reader, see mlsBarcodeReader_GetStats()
+ */
+typedef struct mlsBarcodeStats
+{
+	unsigned long long framesRx;		// packages received with a valid checksum
+	unsigned long long bytesRx;			// bytes read from scanner
+	unsigned long long framesTx;		// packages written to scanner
+	unsigned long long bytesTx;			// bytes written to scanner
+	unsigned long long checksumErrors;	// packages dropped on bad checksum
+	unsigned long long resyncBytes;		// bytes skipped while looking for a package start
+	unsigned long long retransRx;		// packages received with retransmit status bit
+	unsigned long long retransTx;		// packages written again after NAK RESEND or timeout
+	unsigned long long duplicatesRx;	// resent scanner packages already handled, ACKed and dropped
+	unsigned long long nakTx;			// NAK RESEND sent for packages with bad checksum
+	unsigned long long repeatScans;		// barcodes dropped by mlsBarcodeReader_SetDedupWindow()
+	unsigned long long nakResend;		// NAK received, by cause
+	unsigned long long nakBadContext;
+	unsigned long long nakDenied;
+	unsigned long long nakCancel;
+	unsigned long long nakOther;
+	unsigned long long commandTimeouts;	// commands without ACK/NAK in time
+	unsigned long long hangups;			// device hang up detected
+	unsigned long long reopens;			// mlsBarcodeReader_Reopen_r() calls and automatic reconnects
+	unsigned long long queueDrops;		// barcodes lost on full decode queue, see mlsBarcodeReader_SetQueueSize(),
+										// or completed during a command while an earlier one was not read yet
+} mlsBarcodeStats;
+
+/*!
+ * \brief mlsBarcodeRecord one decoded barcode as stored in a reader queue
+ */
+typedef struct mlsBarcodeRecord
+{
+	unsigned int length;				// barcode length in bytes
+	unsigned char symbology;			// MLS_SYMBOLOGY_*
+	struct timespec timestamp;			// CLOCK_MONOTONIC time the last package was received
+	char data[MLS_BARCODE_MAX_LEN];		// barcode data, null terminated
+} mlsBarcodeRecord;
+
+/*!
+ * \brief mlsBarcodeResult one decoded barcode with its metadata, see mlsBarcodeReader_ReadResult()
+ */
+typedef struct mlsBarcodeResult
+{
+	unsigned char symbology;			// MLS_SYMBOLOGY_*
+	const char *data;					// barcode data, in caller buffer
+	unsigned int length;				// barcode length in bytes
+	unsigned int truncatedLen;			// bytes which did not fit in caller buffer
+	const char *deviceId;				// device path of the scanner, valid until reader is destroyed
+	struct timespec firstTimestamp;		// CLOCK_MONOTONIC time the first package was received
+	struct timespec timestamp;			// CLOCK_MONOTONIC time the last package was received
+	unsigned int packetCount;			// number of DEC_DATA packages of the barcode
+} mlsBarcodeResult;
+
+/*!
+ * \brief mlsBarcodeReader_Callback decode event handler
+ * \param reader context of the scanner which decoded the barcode
+ * \param barcode barcode data, null terminated, only valid during the call
+ * \param length barcode length in bytes
+ * \param timestamp CLOCK_MONOTONIC time the last package of the barcode was received
+ * \param userData pointer given at registration
+ */
+typedef void (*mlsBarcodeReader_Callback)(mlsBarcodeReader *reader, const char *barcode, unsigned int length,
+		const struct timespec *timestamp, void *userData);
+
+/*!
+ * \brief mlsBarcodeEngine event loop serving many reader contexts from one thread
+ */
+typedef struct mlsBarcodeEngine mlsBarcodeEngine;
 
 /*!
  * \brief mlsBarcodeReader_Open Open Reader descritptor file for read write
@@ -52,6 +249,7 @@ char mlsBarcodeReader_Disable();
 /*!
  * \brief mlsBarcodeReader_ReadData Reader data from descriptor file (blocking read)
  * \param buff point to buffer which store data.
+ * \param timeout maximum wait time in 1/10 second, see mlsBarcodeReader_ReadDataMs()
  * \return number of byte(s) read.
  */
 unsigned int mlsBarcodeReader_ReadData(char *buff, const int buffLength, const int timeout);
@@ -79,6 +277,410 @@ char *GetVersion(void);
  */
 char mlsBarcodeReader_Reopen(char *name);
 
+/*!
+ * \brief mlsBarcodeReader_Create allocate a reader context for one scanner
+ * \return
+ * - pointer to new reader context: Success
+ * - NULL: Fail
+ */
+mlsBarcodeReader *mlsBarcodeReader_Create(void);
+
+/*!
+ * \brief mlsBarcodeReader_Destroy close scanner if still opened and free reader context
+ */
+void mlsBarcodeReader_Destroy(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_Open_r same as mlsBarcodeReader_Open() on given context
+ */
+char mlsBarcodeReader_Open_r(mlsBarcodeReader *reader, char *name);
+
+/*!
+ * \brief mlsBarcodeReader_Enable_r same as mlsBarcodeReader_Enable() on given context
+ */
+char mlsBarcodeReader_Enable_r(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_Disable_r same as mlsBarcodeReader_Disable() on given context
+ */
+char mlsBarcodeReader_Disable_r(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_ReadData_r same as mlsBarcodeReader_ReadData() on given context
+ */
+unsigned int mlsBarcodeReader_ReadData_r(mlsBarcodeReader *reader, char *buff, const int buffLength, const int timeout);
+
+/*!
+ * \brief mlsBarcodeReader_ReadDataMs same as mlsBarcodeReader_ReadData_r() with timeout in milliseconds
+ * \param timeoutMs maximum wait time in milliseconds, -1 to wait forever
+ * \return number of byte(s) read.
+ */
+unsigned int mlsBarcodeReader_ReadDataMs(mlsBarcodeReader *reader, char *buff, const int buffLength, const int timeoutMs);
+
+/*!
+ * \brief mlsBarcodeReader_SetCommandTimeout set how long commands (Enable, Disable, batches,
+ * parameters at open) wait for the scanner ACK/NAK. Default is 100 ms.
+ * \param timeoutMs wait time in milliseconds, 0 restores default
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetCommandTimeout(mlsBarcodeReader *reader, int timeoutMs);
+
+/*!
+ * \brief mlsBarcodeReader_SetRetryLimit set how many times a command is written again, with the
+ * retransmit status bit, after NAK RESEND or missing reply. Default is 2, 0 disables resends.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetRetryLimit(mlsBarcodeReader *reader, int retries);
+
+/*!
+ * \brief mlsBarcodeReader_ReadResult wait for a barcode and fill result with it and its metadata.
+ * Barcode is reassembled in buff, which result->data points to.
+ * \param timeoutMs maximum wait time in milliseconds, -1 to wait forever
+ * \return
+ * - EXIT_SUCCESS: result is filled
+ * - EXIT_FAILURE: timeout or error
+ */
+char mlsBarcodeReader_ReadResult(mlsBarcodeReader *reader, mlsBarcodeResult *result, char *buff,
+		const int buffLength, const int timeoutMs);
+
+/*!
+ * \brief mlsBarcodeReader_ReadStream wait for a barcode, then also return every further barcode
+ * already received, without waiting again. Barcodes are stored one after the other in buff and
+ * results[i].data points to each of them. A barcode which does not fit in the rest of buff, or is
+ * not complete yet, stays in the reader for the next call; so does a partial barcode on timeout.
+ * Without callback or queue, a barcode completed while a command waited for its reply is kept
+ * and returned first by the next ReadStream, ReadResult or ReadData call.
+ * \param maxCount size of results
+ * \param timeoutMs maximum wait time for the first barcode in milliseconds, -1 to wait forever
+ * \return
+ * - number of results filled, 0 on timeout
+ * - -1: read error
+ */
+int mlsBarcodeReader_ReadStream(mlsBarcodeReader *reader, mlsBarcodeResult *results, unsigned int maxCount,
+		char *buff, const int buffLength, const int timeoutMs);
+
+/*!
+ * \brief mlsBarcodeReader_SetSymbologyFilter only deliver barcodes of the given symbologies.
+ * Other barcodes are ACKed and dropped by the library.
+ * \param symbologies MLS_SYMBOLOGY_* ids to allow, NULL with count 0 allows all
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetSymbologyFilter(mlsBarcodeReader *reader, const unsigned char *symbologies,
+		unsigned int count);
+
+/*!
+ * \brief mlsBarcodeReader_SetDedupWindow drop a barcode (same symbology and data) seen less than
+ * windowMs ago, e.g. a code held in front of a scanner in presentation mode. Every repeat
+ * restarts the window. Dropped barcodes are ACKed and counted in repeatScans. Off by default.
+ * \param windowMs suppression window in milliseconds, 0 disables
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetDedupWindow(mlsBarcodeReader *reader, int windowMs);
+
+/*!
+ * \brief mlsBarcodeReader_SetCapture record every read from and write to the scanner, with
+ * CLOCK_MONOTONIC time stamps, in a binary capture file for barcode_replay. An existing capture
+ * file is appended to. The file is memory mapped, so recording costs no system call per
+ * transfer. Capture survives close and reopen of the scanner.
+ * \param path capture file, NULL stops capture
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetCapture(mlsBarcodeReader *reader, const char *path);
+
+/*!
+ * \brief mlsBarcodeReader_GetLatency copy latency histogram of one stage
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_GetLatency(mlsBarcodeReader *reader, mlsBarcodeLatencyStage stage,
+		mlsBarcodeHistogram *histogram);
+
+/*!
+ * \brief mlsBarcodeReader_ResetLatency clear latency histograms of all stages
+ */
+void mlsBarcodeReader_ResetLatency(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeHistogram_Percentile value below which given percentage of samples fall
+ * \param percentile 0.0 to 100.0
+ * \return upper limit in microseconds of the bucket holding the percentile, 0 if empty
+ */
+unsigned int mlsBarcodeHistogram_Percentile(const mlsBarcodeHistogram *histogram, double percentile);
+
+/*!
+ * \brief mlsBarcodeHistogram_BucketLimit largest value counted in a bucket
+ * \return upper limit in microseconds
+ */
+unsigned int mlsBarcodeHistogram_BucketLimit(unsigned int bucket);
+
+/*!
+ * \brief mlsBarcodeReader_GetStats snapshot of protocol counters, always enabled.
+ * Each counter is read atomically, counters are not synchronized with each other.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_GetStats(mlsBarcodeReader *reader, mlsBarcodeStats *stats);
+
+/*!
+ * \brief mlsBarcodeReader_ResetStats set all protocol counters to 0
+ */
+void mlsBarcodeReader_ResetStats(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeLog_SetLevel select most verbose level logged at runtime.
+ * Default is MLS_LOG_ERROR, or MLS_LOG_DEBUG when STYL_DEBUG is set; STYL_LOG_LEVEL=0..4
+ * overrides both. Environment is read once when the library is loaded.
+ * Levels above MLS_LOG_MIN_LEVEL (build time, default MLS_LOG_DEBUG) are compiled out.
+ */
+void mlsBarcodeLog_SetLevel(mlsBarcodeLogLevel level);
+
+/*!
+ * \brief mlsBarcodeLog_GetLevel most verbose level logged at runtime
+ */
+mlsBarcodeLogLevel mlsBarcodeLog_GetLevel(void);
+
+/*!
+ * \brief mlsBarcodeLog_SetCallback route log messages to application instead of stderr.
+ * Should be set before readers are opened; callback may be called from any library thread.
+ * \param callback handler, NULL for stderr
+ */
+void mlsBarcodeLog_SetCallback(mlsBarcodeLog_Callback callback, void *userData);
+
+/*!
+ * \brief mlsBarcodeReader_GetEvents copy the last MLS_EVENT_LOG_LEN protocol events
+ * of a reader, oldest first. Events are always recorded, whatever the log level.
+ * \return number of events copied
+ */
+unsigned int mlsBarcodeReader_GetEvents(mlsBarcodeReader *reader, mlsBarcodeEvent *events, unsigned int maxCount);
+
+/*!
+ * \brief mlsBarcodeReader_DumpEvents write the last protocol events of a reader as text,
+ * one per line, e.g. after a failure
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_DumpEvents(mlsBarcodeReader *reader, int fd);
+
+/*!
+ * \brief mlsBarcodeReader_GetTruncatedLen number of bytes dropped from the last barcode
+ * because it did not fit in the caller buffer (ReadData_r) or MLS_BARCODE_MAX_LEN.
+ * May be called from the decode callback.
+ * \return 0 if last barcode was complete
+ */
+unsigned int mlsBarcodeReader_GetTruncatedLen(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_Close_r same as mlsBarcodeReader_Close() on given context
+ */
+char mlsBarcodeReader_Close_r(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_Reopen_r same as mlsBarcodeReader_Reopen() on given context
+ */
+char mlsBarcodeReader_Reopen_r(mlsBarcodeReader *reader, char *name);
+
+/*!
+ * \brief mlsBarcodeReader_SendBatch write several commands back to back, then match
+ * their ACK/NAK replies in order, so a multi-step operation costs about one round trip.
+ * A command answered with NAK RESEND or not answered is sent again with the retransmit
+ * bit after the whole batch, so it runs after the commands following it; keep commands
+ * whose order matters in separate calls. Replies carry no command id: a lost reply shifts
+ * the following ones onto the command before theirs, and the last command is resent.
+ * \return
+ * - EXIT_SUCCESS: every command ACKed
+ * - EXIT_FAILURE: at least one command failed, see commands[i].result
+ */
+char mlsBarcodeReader_SendBatch(mlsBarcodeReader *reader, mlsBarcodeCommand *commands, unsigned int count);
+
+/*!
+ * \brief mlsBarcodeReader_SetBaudRate select baud rate negotiated at next open.
+ * Scanner is switched through its baud rate parameter (temporary change) and
+ * the link is verified; on failure both sides fall back to 9600. The scanner is put
+ * back to 9600 at close.
+ * \param baudRate 9600, 19200, 38400, 57600 or 115200
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: unsupported baud rate
+ */
+char mlsBarcodeReader_SetBaudRate(mlsBarcodeReader *reader, unsigned int baudRate);
+
+/*!
+ * \brief mlsBarcodeReader_SetTTYProfile select tty settings applied at next open
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetTTYProfile(mlsBarcodeReader *reader, mlsBarcodeTTYProfile profile);
+
+/*!
+ * \brief mlsBarcodeReader_SetParamProfile set scanner parameters applied at next open.
+ * Current values are requested from scanner and only differing ones are sent.
+ * Default profile (count = 0) is the one of the legacy API.
+ * \param isPermanent non-zero to store parameters in scanner flash; only
+ * permanent profiles are cached, see mlsBarcodeReader_SetParamCacheDir().
+ * Temporary ones, lost on power cycle, are requested from scanner at every open.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetParamProfile(mlsBarcodeReader *reader, const mlsBarcodeParam *params,
+		unsigned int count, int isPermanent);
+
+/*!
+ * \brief mlsBarcodeReader_SetParamCacheDir set directory of per device parameter cache files.
+ * A scanner whose cached values already match the permanent profile is opened
+ * without any parameter traffic. Cached values are the ones the scanner reported
+ * after configuration. Remove the cache file after a scanner reset.
+ * Files are named after the /dev/serial/by-id entry of the scanner; scanners
+ * without one are always configured.
+ * \param path existing directory, NULL to disable cache
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetParamCacheDir(mlsBarcodeReader *reader, const char *path);
+
+/*!
+ * \brief mlsBarcodeReader_SetCallback register decode event handler of a reader context.
+ * Handler is called by mlsBarcodeEngine_Run() for every barcode decoded by this scanner.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetCallback(mlsBarcodeReader *reader, mlsBarcodeReader_Callback callback, void *userData);
+
+/*!
+ * \brief mlsBarcodeReader_StartThread start a library owned thread which waits for
+ * scanner input and calls callback as soon as a barcode is received and ACKed.
+ * callback may be NULL when the decode queue is enabled.
+ * No polling with mlsBarcodeReader_ReadData_r() is needed while the thread runs;
+ * commands (Enable/Disable) can still be sent from any thread. Scanner descriptor is
+ * non-blocking until mlsBarcodeReader_StopThread().
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_StartThread(mlsBarcodeReader *reader, mlsBarcodeReader_Callback callback, void *userData);
+
+/*!
+ * \brief mlsBarcodeReader_StopThread stop reader thread and wait for it to exit.
+ * Must not be called from the callback. Called by mlsBarcodeReader_Close_r().
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_StopThread(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_SetAutoReconnect let reader thread re-open the scanner when it
+ * hangs up (e.g. USB re-enumeration). Device node is watched with inotify and open is
+ * retried with exponential backoff; decode queue and its barcodes are kept meanwhile.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetAutoReconnect(mlsBarcodeReader *reader, int isEnabled);
+
+/*!
+ * \brief mlsBarcodeReader_IsConnected check if scanner is currently opened
+ * \return
+ * - TRUE (1): opened
+ * - FALSE (0): closed or reconnecting
+ */
+int mlsBarcodeReader_IsConnected(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_SetQueueSize enable decode queue of a reader context.
+ * Must be called before mlsBarcodeReader_Open_r(), which preallocates the records.
+ * Barcodes dispatched by reader thread or engine are then stored in a lock-free
+ * single producer/single consumer queue and read with mlsBarcodeReader_Pop().
+ * \param records queue capacity, rounded up to a power of 2. 0 disables the queue.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetQueueSize(mlsBarcodeReader *reader, unsigned int records);
+
+/*!
+ * \brief mlsBarcodeReader_TryPop take oldest barcode from decode queue without waiting
+ * \return
+ * - EXIT_SUCCESS: record is filled
+ * - EXIT_FAILURE: queue is empty or disabled
+ */
+char mlsBarcodeReader_TryPop(mlsBarcodeReader *reader, mlsBarcodeRecord *record);
+
+/*!
+ * \brief mlsBarcodeReader_Pop take oldest barcode from decode queue, waiting for one if empty
+ * \param timeoutMs maximum wait time in milliseconds, -1 to wait forever
+ * \return
+ * - EXIT_SUCCESS: record is filled
+ * - EXIT_FAILURE: timeout, queue disabled or error
+ */
+char mlsBarcodeReader_Pop(mlsBarcodeReader *reader, mlsBarcodeRecord *record, int timeoutMs);
+
+/*!
+ * \brief mlsBarcodeReader_GetQueueFd descriptor which becomes readable when barcodes
+ * are queued, for use in the application's own poll/epoll loop
+ * \return
+ * - eventfd descriptor: Success
+ * - -1: queue is disabled
+ */
+int mlsBarcodeReader_GetQueueFd(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeEngine_Create create an event loop (epoll) for several scanners
+ * \return
+ * - pointer to new engine: Success
+ * - NULL: Fail
+ */
+mlsBarcodeEngine *mlsBarcodeEngine_Create(void);
+
+/*!
+ * \brief mlsBarcodeEngine_Destroy free engine. Attached readers are not closed.
+ */
+void mlsBarcodeEngine_Destroy(mlsBarcodeEngine *engine);
+
+/*!
+ * \brief mlsBarcodeEngine_Add attach an opened reader context to engine.
+ * Scanner descriptor is switched to non-blocking mode; do not call
+ * mlsBarcodeReader_ReadData_r() on this reader while it is attached.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeEngine_Add(mlsBarcodeEngine *engine, mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeEngine_Remove detach reader context from engine and restore blocking mode
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeEngine_Remove(mlsBarcodeEngine *engine, mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeEngine_Run wait for input on all attached scanners and dispatch
+ * decode events to reader callbacks. A scanner that hangs up is detached.
+ * \param timeoutMs maximum wait time in milliseconds, -1 to wait forever
+ * \return
+ * - number of decode events dispatched (0 on timeout)
+ * - -1: Fail
+ */
+int mlsBarcodeEngine_Run(mlsBarcodeEngine *engine, int timeoutMs);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,267 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define CAPTURE_CHUNK_LEN	(1024 * 1024)
+
+static int FindEnd(mlsBarcodeCapture *capture);
+static int Grow(mlsBarcodeCapture *capture, size_t minLen);
+
+/*!
+ * \brief mlsBarcodeReader_SetCapture append raw traffic with the scanner to a capture file
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetCapture(mlsBarcodeReader *reader, const char *path)
+{
+	mlsBarcodeCapture *capture = NULL;
+	mlsBarcodeCaptureHeader header;
+	struct timespec now;
+	struct stat st;
+
+	if (NULL == reader)
+	{
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&reader->ioLock);
+
+	mlsBarcodeCapture_Close(reader);
+	if (NULL == path)
+	{
+		pthread_mutex_unlock(&reader->ioLock);
+		return EXIT_SUCCESS;
+	}
+
+	capture = calloc(1, sizeof(*capture));
+	if (NULL == capture)
+	{
+		LOG_ERRNO(__func__);
+		goto ERROR;
+	}
+
+	capture->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if ( (0 > capture->fd) || (0 > fstat(capture->fd, &st)) )
+	{
+		LOG_ERRNO(path);
+		goto ERROR;
+	}
+
+	if (0 == st.st_size)
+	{
+		if (Grow(capture, sizeof(header)))
+		{
+			goto ERROR;
+		}
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+		clock_gettime(CLOCK_REALTIME, &now);
+		header.realTimeNs = (int64_t) now.tv_sec * 1000000000LL + now.tv_nsec;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		header.monotonicNs = (int64_t) now.tv_sec * 1000000000LL + now.tv_nsec;
+		memcpy(capture->map, &header, sizeof(header));
+		capture->len = sizeof(header);
+	}
+	else
+	{
+		// Append after records of previous captures
+		capture->mapLen = st.st_size;
+		capture->map = mmap(NULL, capture->mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, 0);
+		if (MAP_FAILED == capture->map)
+		{
+			capture->map = NULL;
+			LOG_ERRNO(path);
+			goto ERROR;
+		}
+		if (FindEnd(capture))
+		{
+			LOG_ERROR("%s: not a capture file", path);
+			goto ERROR;
+		}
+	}
+
+	reader->capture = capture;
+	pthread_mutex_unlock(&reader->ioLock);
+
+	LOG_INFO("capture to %s from offset %zu", path, capture->len);
+	return EXIT_SUCCESS;
+
+ERROR:
+	if (NULL != capture)
+	{
+		if (NULL != capture->map)
+		{
+			munmap(capture->map, capture->mapLen);
+		}
+		if (0 <= capture->fd)
+		{
+			close(capture->fd);
+		}
+		free(capture);
+	}
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return EXIT_FAILURE;
+}
+
+/*!
+ * \brief mlsBarcodeCapture_Write append one read or write to reader's capture file, if any.
+ * A failure to grow the file stops the capture. Caller holds ioLock.
+ */
+void mlsBarcodeCapture_Write(mlsBarcodeReader *reader, byte direction, const byte *data, int len,
+		const struct timespec *timestamp)
+{
+	mlsBarcodeCapture *capture = reader->capture;
+	mlsBarcodeCaptureRecord record;
+	struct timespec now;
+
+	if ( (NULL == capture) || (0 >= len) )
+	{
+		return;
+	}
+	assert(len <= UINT16_MAX);
+
+	if (NULL == timestamp)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timestamp = &now;
+	}
+
+	if (capture->len + sizeof(record) + len > capture->mapLen)
+	{
+		if (Grow(capture, capture->len + sizeof(record) + len))
+		{
+			LOG_ERROR("%s: capture stopped", reader->name);
+			mlsBarcodeCapture_Close(reader);
+			return;
+		}
+	}
+
+	record.sec = (uint32_t) timestamp->tv_sec;
+	record.nsec = (uint32_t) timestamp->tv_nsec;
+	record.length = (uint16_t) len;
+	record.direction = direction;
+	record.reserved = 0;
+
+	// Data first: a record is only visible once its direction is written
+	memcpy(&capture->map[capture->len + sizeof(record)], data, len);
+	memcpy(&capture->map[capture->len], &record, sizeof(record));
+	capture->len += sizeof(record) + len;
+}
+
+/*!
+ * \brief mlsBarcodeCapture_Close cut unused end of reader's capture file and close it, if any.
+ * Caller holds ioLock.
+ */
+void mlsBarcodeCapture_Close(mlsBarcodeReader *reader)
+{
+	mlsBarcodeCapture *capture = reader->capture;
+
+	if (NULL == capture)
+	{
+		return;
+	}
+
+	munmap(capture->map, capture->mapLen);
+	if (0 > ftruncate(capture->fd, capture->len))
+	{
+		LOG_ERRNO(__func__);
+	}
+	close(capture->fd);
+	free(capture);
+	reader->capture = NULL;
+}
+
+/*!
+ * \brief FindEnd check file header and find the end of its records, which is either the end of
+ * file or zero bytes left by a process which did not close its capture
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: not a capture file
+ */
+static int FindEnd(mlsBarcodeCapture *capture)
+{
+	mlsBarcodeCaptureRecord record;
+	size_t offset = sizeof(mlsBarcodeCaptureHeader);
+
+	if ( (capture->mapLen < offset) || (0 != memcmp(capture->map, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC))) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	while (capture->mapLen - offset >= sizeof(record))
+	{
+		memcpy(&record, &capture->map[offset], sizeof(record));
+		if ( (0 == record.direction) || (capture->mapLen - offset - sizeof(record) < record.length) )
+		{
+			break;
+		}
+		offset += sizeof(record) + record.length;
+	}
+	capture->len = offset;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief Grow extend capture file to hold at least minLen bytes and map it again
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int Grow(mlsBarcodeCapture *capture, size_t minLen)
+{
+	size_t newLen = capture->mapLen + CAPTURE_CHUNK_LEN;
+	byte *map = NULL;
+
+	if (newLen < minLen)
+	{
+		newLen = minLen + CAPTURE_CHUNK_LEN;
+	}
+
+	if (0 > ftruncate(capture->fd, newLen))
+	{
+		LOG_ERRNO(__func__);
+		return EXIT_FAILURE;
+	}
+
+	if (NULL == capture->map)
+	{
+		map = mmap(NULL, newLen, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, 0);
+	}
+	else
+	{
+		map = mremap(capture->map, capture->mapLen, newLen, MREMAP_MAYMOVE);
+	}
+	if (MAP_FAILED == map)
+	{
+		LOG_ERRNO(__func__);
+		return EXIT_FAILURE;
+	}
+
+	capture->map = map;
+	capture->mapLen = newLen;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define FNV_OFFSET			14695981039346656037ULL
+#define FNV_PRIME			1099511628211ULL
+
+static uint64_t HashBarcode(byte symbology, const char *data, unsigned int len, unsigned int fullLen);
+
+/*!
+ * \brief mlsBarcodeReader_SetDedupWindow drop barcodes equal to one delivered less than
+ * windowMs ago
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetDedupWindow(mlsBarcodeReader *reader, int windowMs)
+{
+	if ( (NULL == reader) || (0 > windowMs) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&reader->ioLock);
+	reader->dedupWindowMs = windowMs;
+	memset(reader->dedup, 0, sizeof(reader->dedup));
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeDedup_IsRepeat look barcode being reassembled up in the reader's recent
+ * barcodes. A repeat extends its own window, so a code held in front of the scanner stays
+ * suppressed. Caller holds ioLock.
+ * \return
+ * - TRUE: repeat within window, drop it
+ * - FALSE: new barcode, remembered from now on
+ */
+int mlsBarcodeDedup_IsRepeat(mlsBarcodeReader *reader, const char *data, unsigned int len)
+{
+	int64_t now = 0;
+	uint64_t hash = 0;
+	mlsBarcodeDedupEntry *entry = NULL;
+	mlsBarcodeDedupEntry *freeEntry = NULL;
+	unsigned int slot = 0;
+
+	// Off by default: no hashing on the decode path
+	if (0 == reader->dedupWindowMs)
+	{
+		return FALSE;
+	}
+
+	now = (int64_t) reader->decodeTime.tv_sec * 1000 + reader->decodeTime.tv_nsec / 1000000;
+	hash = HashBarcode(reader->decodeType, data, len, len + reader->decodeTruncated);
+	slot = (unsigned int) hash & (DEDUP_SLOTS - 1);
+
+	// Linear probing; expired entries are reusable but do not end the search
+	for (unsigned int i = 0; i < DEDUP_SLOTS; i++, slot = (slot + 1) & (DEDUP_SLOTS - 1))
+	{
+		entry = &reader->dedup[slot];
+		if (0 == entry->hash)
+		{
+			if (NULL == freeEntry)
+			{
+				freeEntry = entry;
+			}
+			break;
+		}
+
+		if (entry->expiryMs <= now)
+		{
+			if (NULL == freeEntry)
+			{
+				freeEntry = entry;
+			}
+			continue;
+		}
+
+		if (entry->hash == hash)
+		{
+			entry->expiryMs = now + reader->dedupWindowMs;
+			return TRUE;
+		}
+	}
+
+	// Table full of live entries: replace home slot
+	if (NULL == freeEntry)
+	{
+		freeEntry = &reader->dedup[hash & (DEDUP_SLOTS - 1)];
+	}
+	freeEntry->hash = hash;
+	freeEntry->expiryMs = now + reader->dedupWindowMs;
+
+	return FALSE;
+}
+
+/*!
+ * \brief HashBarcode FNV-1a of symbology, length and stored payload, never 0 (empty slot)
+ */
+static uint64_t HashBarcode(byte symbology, const char *data, unsigned int len, unsigned int fullLen)
+{
+	uint64_t hash = FNV_OFFSET;
+
+	hash = (hash ^ symbology) * FNV_PRIME;
+	for (unsigned int i = 0; i < sizeof(fullLen); i++)
+	{
+		hash = (hash ^ ( (fullLen >> (8 * i)) & 0xFF )) * FNV_PRIME;
+	}
+	for (unsigned int i = 0; i < len; i++)
+	{
+		hash = (hash ^ (byte) data[i]) * FNV_PRIME;
+	}
+
+	return (0 == hash) ? 1 : hash;
+}
@@ -0,0 +1,211 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/epoll.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define MAX_EVENTS			64
+
+/*!
+ * \brief mlsBarcodeEngine epoll instance shared by attached reader contexts
+ */
+struct mlsBarcodeEngine
+{
+	int epfd;
+};
+
+
+/*!
+ * \brief mlsBarcodeEngine_Create create an event loop (epoll) for several scanners
+ * \return
+ * - pointer to new engine: Success
+ * - NULL: Fail
+ */
+mlsBarcodeEngine *mlsBarcodeEngine_Create(void)
+{
+	mlsBarcodeEngine *engine = calloc(1, sizeof(*engine));
+
+	if (NULL == engine)
+	{
+		LOG_ERRNO(__func__);
+		return NULL;
+	}
+
+	engine->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (0 > engine->epfd)
+	{
+		LOG_ERRNO(__func__);
+		free(engine);
+		return NULL;
+	}
+
+	return engine;
+}
+
+/*!
+ * \brief mlsBarcodeEngine_Destroy free engine. Attached readers are not closed.
+ */
+void mlsBarcodeEngine_Destroy(mlsBarcodeEngine *engine)
+{
+	if (NULL == engine)
+	{
+		return;
+	}
+
+	close(engine->epfd);
+	free(engine);
+}
+
+/*!
+ * \brief mlsBarcodeEngine_Add attach an opened reader context to engine
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeEngine_Add(mlsBarcodeEngine *engine, mlsBarcodeReader *reader)
+{
+	struct epoll_event event = { 0 };
+
+	assert(engine != NULL);
+	assert(reader != NULL);
+
+	if (mlsBarcode_SetNonBlocking(reader->fd, TRUE))
+	{
+		return EXIT_FAILURE;
+	}
+
+	event.events = EPOLLIN;
+	event.data.ptr = reader;
+	if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, reader->fd, &event))
+	{
+		LOG_ERRNO(__func__);
+		mlsBarcode_SetNonBlocking(reader->fd, FALSE);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeEngine_Remove detach reader context from engine and restore blocking mode
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeEngine_Remove(mlsBarcodeEngine *engine, mlsBarcodeReader *reader)
+{
+	struct epoll_event event = { 0 };
+
+	assert(engine != NULL);
+	assert(reader != NULL);
+
+	if (epoll_ctl(engine->epfd, EPOLL_CTL_DEL, reader->fd, &event))
+	{
+		LOG_ERRNO(__func__);
+		return EXIT_FAILURE;
+	}
+
+	return mlsBarcode_SetNonBlocking(reader->fd, FALSE);
+}
+
+/*!
+ * \brief mlsBarcodeEngine_Run wait for input on all attached scanners and dispatch
+ * decode events to reader callbacks. A scanner that hangs up is detached.
+ * \return
+ * - number of decode events dispatched (0 on timeout)
+ * - -1: Fail
+ */
+int mlsBarcodeEngine_Run(mlsBarcodeEngine *engine, int timeoutMs)
+{
+	struct epoll_event events[MAX_EVENTS];
+	mlsBarcodeReader *reader = NULL;
+	int decodeCount = 0;
+	int ret = 0;
+	int count = 0;
+
+	assert(engine != NULL);
+
+	count = epoll_wait(engine->epfd, events, MAX_EVENTS, timeoutMs);
+	if (0 > count)
+	{
+		if (EINTR == errno)
+		{
+			return 0;
+		}
+		LOG_ERRNO(__func__);
+		return -1;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		reader = events[i].data.ptr;
+		ret = 0;
+
+		if (events[i].events & EPOLLIN)
+		{
+			ret = mlsBarcodeReader_ServiceInput(reader);
+		}
+
+		if ( (0 > ret) || (events[i].events & (EPOLLHUP | EPOLLERR)) )
+		{
+			LOG_ERROR("%s hang up", reader->name);
+			epoll_ctl(engine->epfd, EPOLL_CTL_DEL, reader->fd, &events[i]);
+			continue;
+		}
+
+		decodeCount += ret;
+	}
+
+	return decodeCount;
+}
+
+/*!
+ * \brief mlsBarcode_SetNonBlocking set or clear O_NONBLOCK of descriptor
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+int mlsBarcode_SetNonBlocking(int fd, int isNonBlocking)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (0 > flags)
+	{
+		LOG_ERRNO("F_GETFL");
+		return EXIT_FAILURE;
+	}
+
+	if (isNonBlocking)
+	{
+		flags |= O_NONBLOCK;
+	}
+	else
+	{
+		flags &= ~O_NONBLOCK;
+	}
+
+	if (fcntl(fd, F_SETFL, flags))
+	{
+		LOG_ERRNO("F_SETFL");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,372 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+#ifndef MLSBARCODEINTERNAL_H
+#define MLSBARCODEINTERNAL_H
+
+#include <stdint.h>
+#include <termios.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ssi.h"
+#include "mlsBarcode.h"
+
+#define TRUE				1
+#define FALSE				0
+
+#define RECV_BUFF_LEN		MLS_BARCODE_MAX_LEN
+#define RX_BUFF_LEN			1024
+#define MAX_DEV_NAME_LEN	256
+#define CACHE_LINE_LEN		64
+#define MAX_PROFILE_PARAMS	64
+#define PARAM_REPLY_LEN		(2 * MAX_PKG_LEN)
+#define DEDUP_SLOTS			64		// power of 2
+
+// Capture file, see mlsBarcodeReader_SetCapture()
+#define CAPTURE_MAGIC		"SSICAP1"	// 8 bytes with terminating NUL
+#define CAPTURE_RX			1			// bytes read from scanner
+#define CAPTURE_TX			2			// bytes written to scanner
+
+// Build time minimum: messages above this level are compiled out
+#ifndef MLS_LOG_MIN_LEVEL
+#define MLS_LOG_MIN_LEVEL	MLS_LOG_DEBUG
+#endif
+
+#define MLS_LOG(level, ...) \
+	do { \
+		if ( ((level) <= MLS_LOG_MIN_LEVEL) && \
+				((int) (level) <= __atomic_load_n(&mlsBarcodeLog_level, __ATOMIC_RELAXED)) ) \
+		{ \
+			mlsBarcodeLog_Write((level), __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define LOG_ERROR(...)		MLS_LOG(MLS_LOG_ERROR, __VA_ARGS__)
+#define LOG_WARNING(...)	MLS_LOG(MLS_LOG_WARNING, __VA_ARGS__)
+#define LOG_INFO(...)		MLS_LOG(MLS_LOG_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...)		MLS_LOG(MLS_LOG_DEBUG, __VA_ARGS__)
+#define IS_LOG_DEBUG()		( (MLS_LOG_DEBUG <= MLS_LOG_MIN_LEVEL) && \
+								(MLS_LOG_DEBUG <= __atomic_load_n(&mlsBarcodeLog_level, __ATOMIC_RELAXED)) )
+
+// Replaces perror()
+#define LOG_ERRNO(what) \
+	do { \
+		if ( (MLS_LOG_ERROR <= MLS_LOG_MIN_LEVEL) && \
+				(MLS_LOG_ERROR <= __atomic_load_n(&mlsBarcodeLog_level, __ATOMIC_RELAXED)) ) \
+		{ \
+			mlsBarcodeLog_Errno(what); \
+		} \
+	} while (0)
+
+// Counters are independent of each other, a snapshot needs no ordering
+#define COUNTER_ADD(reader, counter, n)	__atomic_fetch_add(&(reader)->stats.counter, (n), __ATOMIC_RELAXED)
+
+/*!
+ * \brief mlsBarcodeRing bounded single producer/single consumer queue of barcode records.
+ * Producer and consumer indexes live on separate cache lines; records are
+ * allocated once by mlsBarcodeRing_Create().
+ */
+typedef struct mlsBarcodeRing
+{
+	uint32_t tail __attribute__((aligned(CACHE_LINE_LEN)));	// next slot to write, producer only
+	uint32_t head __attribute__((aligned(CACHE_LINE_LEN)));	// next slot to read, consumer only
+	uint32_t mask __attribute__((aligned(CACHE_LINE_LEN)));	// capacity - 1
+	int eventFd;											// signaled on every push
+	mlsBarcodeRecord *records;
+} mlsBarcodeRing;
+
+/*!
+ * \brief mlsBarcodeDedupEntry recently delivered barcode, see mlsBarcodeDedup_IsRepeat()
+ */
+typedef struct mlsBarcodeDedupEntry
+{
+	uint64_t hash;							// symbology, length and payload hash, 0 = never used
+	int64_t expiryMs;						// CLOCK_MONOTONIC ms after which repeats are delivered again
+} mlsBarcodeDedupEntry;
+
+/*!
+ * \brief mlsBarcodeCaptureHeader start of a capture file
+ */
+typedef struct mlsBarcodeCaptureHeader
+{
+	char magic[8];							// CAPTURE_MAGIC
+	int64_t realTimeNs;						// CLOCK_REALTIME when file was created
+	int64_t monotonicNs;					// CLOCK_MONOTONIC at the same time
+} mlsBarcodeCaptureHeader;
+
+/*!
+ * \brief mlsBarcodeCaptureRecord header of one read or write, followed by its length raw bytes.
+ * Records are packed back to back, unaligned; direction 0 ends the capture.
+ */
+typedef struct mlsBarcodeCaptureRecord
+{
+	uint32_t sec;							// CLOCK_MONOTONIC time of the read or write
+	uint32_t nsec;
+	uint16_t length;
+	uint8_t direction;						// CAPTURE_RX or CAPTURE_TX
+	uint8_t reserved;
+} mlsBarcodeCaptureRecord;
+
+/*!
+ * \brief mlsBarcodeCapture capture file being appended, mapped in memory so that a record
+ * costs a copy and no system call. Grown by ftruncate() in CAPTURE_CHUNK_LEN steps.
+ */
+typedef struct mlsBarcodeCapture
+{
+	int fd;
+	byte *map;								// whole file
+	size_t mapLen;							// file size
+	size_t len;								// bytes of header and records, rest is zero
+} mlsBarcodeCapture;
+
+/*!
+ * \brief mlsBarcodePendingDecode barcode completed while a command waited for its reply,
+ * on a reader without callback or queue. Already ACKed, kept for the next read.
+ */
+typedef struct mlsBarcodePendingDecode
+{
+	int isPending;
+	int length;
+	unsigned int truncatedLen;				// bytes which did not fit in decodeBuff
+	unsigned int packets;					// DEC_DATA packages of the barcode
+	byte symbology;
+	struct timespec firstTime;				// CLOCK_MONOTONIC time of first package
+	struct timespec time;					// CLOCK_MONOTONIC time of last package
+	char data[RECV_BUFF_LEN];
+} mlsBarcodePendingDecode;
+
+/*!
+ * \brief mlsBarcodeReader reader context, one per scanner device
+ */
+struct mlsBarcodeReader
+{
+	int fd;									// scanner file descriptor, -1 if closed
+	char name[MAX_DEV_NAME_LEN];			// device path used by Open/Reopen
+	int hasSavedConf;						// TRUE if savedConf holds settings to restore on close
+	struct termios savedConf;				// tty settings before ConfigTTY()
+
+	// Incremental input, kept across reads so no package is lost on timeout
+	byte rxBuff[RX_BUFF_LEN];				// received bytes not yet parsed into packages
+	int rxLen;
+	struct timespec rxTime;					// CLOCK_MONOTONIC time of last read
+	struct timespec rxStartTime;			// CLOCK_MONOTONIC time first byte of rxBuff was read
+	char decodeBuff[RECV_BUFF_LEN];			// barcode being reassembled from DEC_DATA packages
+	int decodeLen;
+	char *decodeDest;						// caller buffer reassembled into instead, NULL = decodeBuff
+	int decodeDestLen;
+	unsigned int decodeTruncated;			// bytes of current barcode which did not fit
+	unsigned int decodePackets;				// DEC_DATA packages of current barcode, 0 = none yet
+	byte decodeType;						// symbology of current barcode
+	struct timespec decodeTime;				// CLOCK_MONOTONIC time of first package
+	struct timespec decodeStartTime;		// CLOCK_MONOTONIC time of first byte
+	mlsBarcodePendingDecode pending;		// see DispatchDecode()
+	struct timespec ackTime;				// CLOCK_MONOTONIC time ACK of last package was written
+	mlsBarcodeHistogram latency[MLS_LATENCY_STAGES];
+	mlsBarcodeStats stats;					// protocol counters, see COUNTER_ADD()
+	mlsBarcodeEvent events[MLS_EVENT_LOG_LEN];	// last protocol events, see mlsBarcodeLog_Event()
+	uint32_t eventCount;					// events recorded since creation
+	uint32_t symbologyDeny[MLS_SYMBOLOGY_COUNT / 32];	// bit set = symbology dropped
+	int dedupWindowMs;						// repeat suppression window, 0 = off
+	mlsBarcodeDedupEntry dedup[DEDUP_SLOTS];	// open addressing set of recent barcodes
+	mlsBarcodeCapture *capture;				// raw traffic capture, NULL = off
+	byte lastReply;							// SSI_CMD_ACK/SSI_CMD_NAK of last command
+	byte lastCause;							// NAK cause
+	int commandTimeoutMs;					// ACK/NAK wait time, 0 = ACK_TIMEOUT_MSEC
+	int retryLimit;							// resends of a command after NAK RESEND or no reply
+	uint32_t lastRxKey;						// length, opcode and checksum of last scanner package, see IsDuplicate()
+
+	unsigned int baudRate;					// requested baud rate, 0 = 9600
+	mlsBarcodeTTYProfile ttyProfile;		// tty settings applied at open
+
+	// Scanner parameters applied at open, see mlsBarcodeReader_SetParamProfile()
+	mlsBarcodeParam params[MAX_PROFILE_PARAMS];
+	unsigned int paramCount;				// 0 = built-in profile
+	int isParamPermanent;					// TRUE to store parameters in scanner flash
+	char cacheDir[MAX_DEV_NAME_LEN];		// parameter cache directory, empty = no cache
+	byte paramReply[PARAM_REPLY_LEN];		// PARAM_SEND data reassembled from scanner packages
+	int paramReplyLen;
+
+	mlsBarcodeReader_Callback callback;		// decode event handler
+	void *userData;
+
+	unsigned int queueSize;					// requested decode queue capacity, 0 = disabled
+	mlsBarcodeRing *queue;					// decode queue, created at open
+
+	pthread_mutex_t ioLock;					// serializes scanner I/O between app and reader thread
+	pthread_t thread;						// background reader, see mlsBarcodeReader_StartThread()
+	int isThreadRunning;
+	int isAutoReconnect;					// TRUE if reader thread re-opens scanner after hang up
+	int stopFd;								// eventfd waking reader thread up to exit
+};
+
+extern int mlsBarcodeLog_level;
+
+/*!
+ * \brief mlsBarcodeLog_Write format one message and pass it to log callback,
+ * or write it to stderr as a single line. Use LOG_* macros instead.
+ */
+void mlsBarcodeLog_Write(mlsBarcodeLogLevel level, const char *format, ...)
+		__attribute__((format(printf, 2, 3)));
+
+/*!
+ * \brief mlsBarcodeLog_Errno log failed system call with errno description. Use LOG_ERRNO().
+ */
+void mlsBarcodeLog_Errno(const char *what);
+
+/*!
+ * \brief mlsBarcodeLog_Event store protocol event in the reader's event ring. Caller holds ioLock.
+ * \param pkg package the event is about, NULL if none
+ * \param timestamp time of event, NULL for now
+ */
+void mlsBarcodeLog_Event(mlsBarcodeReader *reader, unsigned char type, const byte *pkg,
+		const struct timespec *timestamp);
+
+/*!
+ * \brief mlsBarcodeReader_ServiceInput read all pending bytes from scanner, ACK and
+ * dispatch complete packages. Scanner descriptor must be in non-blocking mode.
+ * \return
+ * - number of decode events dispatched to reader callback
+ * - -1: read error or device hang up
+ */
+int mlsBarcodeReader_ServiceInput(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_FeedInput handle bytes as if they were read from scanner:
+ * ACK and dispatch complete packages like mlsBarcodeReader_ServiceInput()
+ * \return number of decode events dispatched to reader callback
+ */
+int mlsBarcodeReader_FeedInput(mlsBarcodeReader *reader, const byte *data, int len);
+
+/*!
+ * \brief mlsBarcodeReader_Detach release descriptor and lock of a scanner which is gone.
+ * Unlike mlsBarcodeReader_Close_r() the reader thread and decode queue are kept.
+ */
+void mlsBarcodeReader_Detach(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_Reconnect wait for device node to come back and open it again,
+ * retrying with exponential backoff. Called by reader thread after a hang up.
+ * \return
+ * - EXIT_SUCCESS: scanner is opened again
+ * - EXIT_FAILURE: stopFd was signaled or watch failed
+ */
+int mlsBarcodeReader_Reconnect(mlsBarcodeReader *reader, int stopFd);
+
+/*!
+ * \brief mlsBarcodeLatency_Record add intervals of the barcode being handed to application
+ * to latency histograms. Caller holds ioLock.
+ */
+void mlsBarcodeLatency_Record(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeDedup_IsRepeat look barcode being reassembled up in the reader's recent
+ * barcodes. A repeat extends its own window. Caller holds ioLock.
+ * \return
+ * - TRUE: repeat within window, drop it
+ * - FALSE: new barcode, remembered from now on
+ */
+int mlsBarcodeDedup_IsRepeat(mlsBarcodeReader *reader, const char *data, unsigned int len);
+
+/*!
+ * \brief mlsBarcodeCapture_Write append one read or write to reader's capture file, if any.
+ * Caller holds ioLock.
+ * \param timestamp CLOCK_MONOTONIC time of the transfer, NULL = now
+ */
+void mlsBarcodeCapture_Write(mlsBarcodeReader *reader, byte direction, const byte *data, int len,
+		const struct timespec *timestamp);
+
+/*!
+ * \brief mlsBarcodeCapture_Close flush and close reader's capture file, if any. Caller holds ioLock.
+ */
+void mlsBarcodeCapture_Close(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcode_SetNonBlocking set or clear O_NONBLOCK of descriptor
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+int mlsBarcode_SetNonBlocking(int fd, int isNonBlocking);
+
+/*!
+ * \brief mlsBarcode_GetTimeMs monotonic clock in milliseconds
+ */
+int64_t mlsBarcode_GetTimeMs(void);
+
+/*!
+ * \brief mlsBarcodeParam_GetProfile parameters to apply at open
+ * \return pointer to profile, count is set to its number of parameters
+ */
+const mlsBarcodeParam *mlsBarcodeParam_GetProfile(mlsBarcodeReader *reader, unsigned int *count);
+
+/*!
+ * \brief mlsBarcodeParam_Find look parameter up in a list
+ * \return
+ * - pointer to parameter
+ * - NULL: not found
+ */
+const mlsBarcodeParam *mlsBarcodeParam_Find(const mlsBarcodeParam *params, unsigned int count,
+		unsigned short number);
+
+/*!
+ * \brief mlsBarcodeParam_Encode write parameter numbers, and values if requested,
+ * in SSI format (0xF0-0xF2 prefix for numbers above 0xFF)
+ * \return number of bytes written
+ */
+int mlsBarcodeParam_Encode(const mlsBarcodeParam *params, unsigned int count, byte *buff, int withValues);
+
+/*!
+ * \brief mlsBarcodeParam_Decode parse number/value pairs of a scanner PARAM_SEND message
+ * \return number of parameters decoded
+ */
+int mlsBarcodeParam_Decode(const byte *buff, int len, mlsBarcodeParam *params, unsigned int maxCount);
+
+/*!
+ * \brief mlsBarcodeParam_LoadCache read cached parameter values of the opened device
+ * \return
+ * - number of cached parameters
+ * - -1: no cache for this device
+ */
+int mlsBarcodeParam_LoadCache(mlsBarcodeReader *reader, mlsBarcodeParam *params, unsigned int maxCount);
+
+/*!
+ * \brief mlsBarcodeParam_SaveCache replace cache file of the opened device
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+int mlsBarcodeParam_SaveCache(mlsBarcodeReader *reader, const mlsBarcodeParam *params, unsigned int count);
+
+/*!
+ * \brief mlsBarcodeRing_Create allocate queue and all its records
+ * \return
+ * - pointer to new queue: Success
+ * - NULL: Fail
+ */
+mlsBarcodeRing *mlsBarcodeRing_Create(unsigned int records);
+
+/*!
+ * \brief mlsBarcodeRing_Destroy free queue and its records
+ */
+void mlsBarcodeRing_Destroy(mlsBarcodeRing *ring);
+
+/*!
+ * \brief mlsBarcodeRing_Push copy barcode into next free record (producer side)
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: queue is full, barcode is dropped
+ */
+int mlsBarcodeRing_Push(mlsBarcodeRing *ring, const char *barcode, unsigned int length,
+		unsigned char symbology, const struct timespec *timestamp);
+
+#endif // MLSBARCODEINTERNAL_H
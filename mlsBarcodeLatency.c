@@ -0,0 +1,202 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define SUB_BUCKET_BITS		3
+#define SUB_BUCKETS			(1 << SUB_BUCKET_BITS)
+#define LINEAR_LIMIT		(2 * SUB_BUCKETS)		// values below have one bucket each
+
+static unsigned int GetBucket(uint32_t valueUs);
+static uint32_t GetIntervalUs(const struct timespec *from, const struct timespec *to);
+static void AddSample(mlsBarcodeHistogram *histogram, uint32_t valueUs);
+
+/*!
+ * \brief mlsBarcodeReader_GetLatency copy latency histogram of one stage
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_GetLatency(mlsBarcodeReader *reader, mlsBarcodeLatencyStage stage,
+		mlsBarcodeHistogram *histogram)
+{
+	if ( (NULL == reader) || (NULL == histogram) || (MLS_LATENCY_STAGES <= (unsigned int) stage) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&reader->ioLock);
+	*histogram = reader->latency[stage];
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_ResetLatency clear latency histograms of all stages
+ */
+void mlsBarcodeReader_ResetLatency(mlsBarcodeReader *reader)
+{
+	assert(reader != NULL);
+
+	pthread_mutex_lock(&reader->ioLock);
+	memset(reader->latency, 0, sizeof(reader->latency));
+	pthread_mutex_unlock(&reader->ioLock);
+}
+
+/*!
+ * \brief mlsBarcodeHistogram_Percentile value below which given percentage of samples fall
+ * \return upper limit in microseconds of the bucket holding the percentile, 0 if empty
+ */
+unsigned int mlsBarcodeHistogram_Percentile(const mlsBarcodeHistogram *histogram, double percentile)
+{
+	unsigned long long rank = 0;
+	unsigned long long seen = 0;
+
+	assert(histogram != NULL);
+
+	if (0 == histogram->count)
+	{
+		return 0;
+	}
+
+	if (percentile < 0.0)
+	{
+		percentile = 0.0;
+	}
+	else if (percentile > 100.0)
+	{
+		percentile = 100.0;
+	}
+
+	// Rank of the sample, 1 based
+	rank = (unsigned long long) (percentile * histogram->count / 100.0 + 0.5);
+	if (0 == rank)
+	{
+		rank = 1;
+	}
+
+	for (unsigned int i = 0; i < MLS_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram->buckets[i];
+		if (seen >= rank)
+		{
+			// Bucket limit may exceed the largest sample
+			return (mlsBarcodeHistogram_BucketLimit(i) < histogram->maxUs) ?
+					mlsBarcodeHistogram_BucketLimit(i) : histogram->maxUs;
+		}
+	}
+
+	return histogram->maxUs;
+}
+
+/*!
+ * \brief mlsBarcodeHistogram_BucketLimit largest value counted in a bucket
+ * \return upper limit in microseconds
+ */
+unsigned int mlsBarcodeHistogram_BucketLimit(unsigned int bucket)
+{
+	unsigned int shift = 0;
+	uint64_t limit = 0;
+
+	if (bucket < LINEAR_LIMIT)
+	{
+		return bucket;
+	}
+
+	if (bucket >= MLS_HISTOGRAM_BUCKETS)
+	{
+		return UINT32_MAX;
+	}
+
+	shift = bucket / SUB_BUCKETS - 1;
+	limit = ( ( (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) + 1 ) << shift ) - 1;
+
+	return (unsigned int) limit;
+}
+
+/*!
+ * \brief mlsBarcodeLatency_Record add intervals of the barcode being handed to application
+ * to latency histograms. Caller holds ioLock.
+ */
+void mlsBarcodeLatency_Record(mlsBarcodeReader *reader)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	AddSample(&reader->latency[MLS_LATENCY_WIRE], GetIntervalUs(&reader->decodeStartTime, &reader->rxTime));
+	AddSample(&reader->latency[MLS_LATENCY_ACK], GetIntervalUs(&reader->rxTime, &reader->ackTime));
+	AddSample(&reader->latency[MLS_LATENCY_DELIVERY], GetIntervalUs(&reader->rxTime, &now));
+	AddSample(&reader->latency[MLS_LATENCY_TOTAL], GetIntervalUs(&reader->decodeStartTime, &now));
+}
+
+/*!
+ * \brief AddSample count one value in histogram
+ */
+static void AddSample(mlsBarcodeHistogram *histogram, uint32_t valueUs)
+{
+	if ( (0 == histogram->count) || (valueUs < histogram->minUs) )
+	{
+		histogram->minUs = valueUs;
+	}
+	if (valueUs > histogram->maxUs)
+	{
+		histogram->maxUs = valueUs;
+	}
+
+	histogram->count++;
+	histogram->sumUs += valueUs;
+	histogram->buckets[GetBucket(valueUs)]++;
+}
+
+/*!
+ * \brief GetBucket log-linear bucket of a value: linear below LINEAR_LIMIT, then
+ * SUB_BUCKETS buckets per power of 2
+ * \return bucket index
+ */
+static unsigned int GetBucket(uint32_t valueUs)
+{
+	unsigned int msb = 0;
+	unsigned int shift = 0;
+
+	if (valueUs < LINEAR_LIMIT)
+	{
+		return valueUs;
+	}
+
+	msb = 31 - __builtin_clz(valueUs);
+	shift = msb - SUB_BUCKET_BITS;
+
+	return (shift + 1) * SUB_BUCKETS + ( (valueUs >> shift) & (SUB_BUCKETS - 1) );
+}
+
+/*!
+ * \brief GetIntervalUs time between two CLOCK_MONOTONIC timestamps
+ * \return microseconds, 0 if to is before from, saturated to UINT32_MAX
+ */
+static uint32_t GetIntervalUs(const struct timespec *from, const struct timespec *to)
+{
+	int64_t us = ( (int64_t) (to->tv_sec - from->tv_sec) * 1000000 ) + ( (to->tv_nsec - from->tv_nsec) / 1000 );
+
+	if (us < 0)
+	{
+		return 0;
+	}
+
+	return (us > UINT32_MAX) ? UINT32_MAX : (uint32_t) us;
+}
@@ -0,0 +1,239 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define LOG_LINE_LEN		512
+
+static void LogInit(void) __attribute__((constructor));
+static const char *GetLevelName(mlsBarcodeLogLevel level);
+static const char *GetEventName(unsigned char type);
+
+// Runtime level, read by LOG_* macros without lock
+int mlsBarcodeLog_level = MLS_LOG_ERROR;
+
+static mlsBarcodeLog_Callback logCallback = NULL;
+static void *logUserData = NULL;
+
+/*!
+ * \brief LogInit read log level from environment once, when library is loaded.
+ * STYL_DEBUG (any value) selects debug level, STYL_LOG_LEVEL (0-4) selects any level.
+ */
+static void LogInit(void)
+{
+	const char *level = getenv("STYL_LOG_LEVEL");
+
+	if (NULL != getenv("STYL_DEBUG"))
+	{
+		mlsBarcodeLog_level = MLS_LOG_DEBUG;
+	}
+
+	if ( (NULL != level) && (level[0] >= '0') && (level[0] <= '0' + MLS_LOG_DEBUG) )
+	{
+		mlsBarcodeLog_level = level[0] - '0';
+	}
+}
+
+/*!
+ * \brief mlsBarcodeLog_SetLevel select most verbose level logged at runtime
+ */
+void mlsBarcodeLog_SetLevel(mlsBarcodeLogLevel level)
+{
+	__atomic_store_n(&mlsBarcodeLog_level, (int) level, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief mlsBarcodeLog_GetLevel most verbose level logged at runtime
+ */
+mlsBarcodeLogLevel mlsBarcodeLog_GetLevel(void)
+{
+	return (mlsBarcodeLogLevel) __atomic_load_n(&mlsBarcodeLog_level, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief mlsBarcodeLog_SetCallback route log messages to application
+ */
+void mlsBarcodeLog_SetCallback(mlsBarcodeLog_Callback callback, void *userData)
+{
+	logUserData = userData;
+	logCallback = callback;
+}
+
+/*!
+ * \brief mlsBarcodeLog_Write format one message and pass it to log callback,
+ * or write it to stderr as a single line
+ */
+void mlsBarcodeLog_Write(mlsBarcodeLogLevel level, const char *format, ...)
+{
+	char line[LOG_LINE_LEN];
+	int len = 0;
+	va_list args;
+
+	len = snprintf(line, sizeof(line), "%s: ", GetLevelName(level));
+
+	va_start(args, format);
+	vsnprintf(&line[len], sizeof(line) - len - 1, format, args);
+	va_end(args);
+
+	if (NULL != logCallback)
+	{
+		logCallback(level, &line[len], logUserData);
+		return;
+	}
+
+	len = strlen(line);
+	line[len++] = '\n';
+	fwrite(line, 1, len, stderr);
+}
+
+/*!
+ * \brief mlsBarcodeLog_Errno log failed system call with errno description
+ */
+void mlsBarcodeLog_Errno(const char *what)
+{
+	const int error = errno;
+
+	mlsBarcodeLog_Write(MLS_LOG_ERROR, "%s: %s", what, strerror(error));
+	errno = error;
+}
+
+/*!
+ * \brief mlsBarcodeLog_Event store protocol event in the reader's event ring. Caller holds ioLock.
+ * \param pkg package the event is about, NULL if none
+ * \param timestamp time of event, NULL for now
+ */
+void mlsBarcodeLog_Event(mlsBarcodeReader *reader, unsigned char type, const byte *pkg,
+		const struct timespec *timestamp)
+{
+	mlsBarcodeEvent *event = &reader->events[reader->eventCount % MLS_EVENT_LOG_LEN];
+
+	if (NULL != timestamp)
+	{
+		event->timestamp = *timestamp;
+	}
+	else
+	{
+		clock_gettime(CLOCK_MONOTONIC, &event->timestamp);
+	}
+
+	event->type = type;
+	event->length = (NULL != pkg) ? PKG_LEN(pkg) : 0;
+	event->opcode = (NULL != pkg) ? pkg[INDEX_OPCODE] : 0;
+	event->status = (NULL != pkg) ? pkg[INDEX_STAT] : 0;
+	event->data = ( (NULL != pkg) && (PKG_LEN(pkg) > SSI_HEADER_LEN) ) ? pkg[SSI_HEADER_LEN] : 0;
+
+	reader->eventCount++;
+}
+
+/*!
+ * \brief mlsBarcodeReader_GetEvents copy last protocol events of a reader, oldest first
+ * \return number of events copied
+ */
+unsigned int mlsBarcodeReader_GetEvents(mlsBarcodeReader *reader, mlsBarcodeEvent *events, unsigned int maxCount)
+{
+	unsigned int count = 0;
+	uint32_t first = 0;
+
+	assert(reader != NULL);
+	assert( (events != NULL) || (0 == maxCount) );
+
+	pthread_mutex_lock(&reader->ioLock);
+
+	count = (reader->eventCount < MLS_EVENT_LOG_LEN) ? reader->eventCount : MLS_EVENT_LOG_LEN;
+	if (count > maxCount)
+	{
+		count = maxCount;
+	}
+
+	first = reader->eventCount - count;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		events[i] = reader->events[(first + i) % MLS_EVENT_LOG_LEN];
+	}
+
+	pthread_mutex_unlock(&reader->ioLock);
+
+	return count;
+}
+
+/*!
+ * \brief mlsBarcodeReader_DumpEvents write last protocol events of a reader as text, oldest first
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_DumpEvents(mlsBarcodeReader *reader, int fd)
+{
+	mlsBarcodeEvent events[MLS_EVENT_LOG_LEN];
+	unsigned int count = mlsBarcodeReader_GetEvents(reader, events, MLS_EVENT_LOG_LEN);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (0 > dprintf(fd, "%ld.%06ld %-8s op=0x%02x len=%u stat=0x%02x data=0x%02x\n",
+				(long) events[i].timestamp.tv_sec, events[i].timestamp.tv_nsec / 1000,
+				GetEventName(events[i].type), events[i].opcode, events[i].length,
+				events[i].status, events[i].data))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief GetLevelName prefix of messages of a level
+ */
+static const char *GetLevelName(mlsBarcodeLogLevel level)
+{
+	switch (level)
+	{
+		case MLS_LOG_ERROR:
+			return "ERROR";
+		case MLS_LOG_WARNING:
+			return "WARNING";
+		case MLS_LOG_INFO:
+			return "INFO";
+		default:
+			return "DEBUG";
+	}
+}
+
+/*!
+ * \brief GetEventName text of an event type
+ */
+static const char *GetEventName(unsigned char type)
+{
+	switch (type)
+	{
+		case MLS_EVENT_RX:
+			return "RX";
+		case MLS_EVENT_TX:
+			return "TX";
+		case MLS_EVENT_CKSUM:
+			return "CKSUM";
+		case MLS_EVENT_TIMEOUT:
+			return "TIMEOUT";
+		case MLS_EVENT_HANGUP:
+			return "HANGUP";
+		default:
+			return "?";
+	}
+}
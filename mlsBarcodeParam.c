@@ -0,0 +1,348 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <assert.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define SERIAL_BY_ID_PATH	"/dev/serial/by-id"
+#define CACHE_HEADER		"# stylssi parameter cache v1\n"
+
+static int GetDeviceId(mlsBarcodeReader *reader, char *id, size_t idLen);
+static int GetCachePath(mlsBarcodeReader *reader, char *path, size_t pathLen);
+
+// Profile applied when the application does not set one
+static const mlsBarcodeParam defaultProfile[] = {
+	{ PARAM_B_DEC_FORMAT, ENABLE },
+	{ PARAM_B_SW_ACK, ENABLE },
+	{ PARAM_B_SCAN_PARAM, DISABLE },	// Disable to avoid accidental changes param from scanning
+	{ PARAM_TRIGGER_MODE, PARAM_TRIGGER_PRESENT },
+	{ PARAM_EXT(PARAM_INDEX_F0, PARAM_B_DEC_EVENT), ENABLE }
+};
+
+/*!
+ * \brief mlsBarcodeReader_SetParamProfile set scanner parameters applied at open
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetParamProfile(mlsBarcodeReader *reader, const mlsBarcodeParam *params,
+		unsigned int count, int isPermanent)
+{
+	if ( (NULL == reader) || (MAX_PROFILE_PARAMS < count) || ( (NULL == params) && (0 != count) ) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (PARAM_NUMBER_MAX < params[i].number)
+		{
+			LOG_ERROR("%s: bad parameter number 0x%x", __func__, params[i].number);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (0 < count)
+	{
+		memcpy(reader->params, params, count * sizeof(*params));
+	}
+	reader->paramCount = count;
+	reader->isParamPermanent = isPermanent ? TRUE : FALSE;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_SetParamCacheDir set directory of per device parameter cache files
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetParamCacheDir(mlsBarcodeReader *reader, const char *path)
+{
+	if (NULL == reader)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (NULL == path)
+	{
+		reader->cacheDir[0] = '\0';
+		return EXIT_SUCCESS;
+	}
+
+	if (strlen(path) >= sizeof(reader->cacheDir))
+	{
+		return EXIT_FAILURE;
+	}
+	strcpy(reader->cacheDir, path);
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeParam_GetProfile parameters to apply at open
+ * \return pointer to profile, count is set to its number of parameters
+ */
+const mlsBarcodeParam *mlsBarcodeParam_GetProfile(mlsBarcodeReader *reader, unsigned int *count)
+{
+	if (0 == reader->paramCount)
+	{
+		*count = sizeof(defaultProfile) / sizeof(*defaultProfile);
+		return defaultProfile;
+	}
+
+	*count = reader->paramCount;
+	return reader->params;
+}
+
+/*!
+ * \brief mlsBarcodeParam_Find look parameter up in a list
+ * \return
+ * - pointer to parameter
+ * - NULL: not found
+ */
+const mlsBarcodeParam *mlsBarcodeParam_Find(const mlsBarcodeParam *params, unsigned int count,
+		unsigned short number)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (number == params[i].number)
+		{
+			return &params[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief mlsBarcodeParam_Encode write parameter numbers, and values if requested,
+ * in SSI format (0xF0-0xF2 prefix for numbers above 0xFF)
+ * \return number of bytes written
+ */
+int mlsBarcodeParam_Encode(const mlsBarcodeParam *params, unsigned int count, byte *buff, int withValues)
+{
+	int len = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (params[i].number > UINT8_MAX)
+		{
+			buff[len++] = PARAM_INDEX_F0 + (params[i].number >> 8) - 1;
+		}
+		buff[len++] = params[i].number & UINT8_MAX;
+
+		if (withValues)
+		{
+			buff[len++] = params[i].value;
+		}
+	}
+
+	return len;
+}
+
+/*!
+ * \brief mlsBarcodeParam_Decode parse number/value pairs of a scanner PARAM_SEND message
+ * \return number of parameters decoded
+ */
+int mlsBarcodeParam_Decode(const byte *buff, int len, mlsBarcodeParam *params, unsigned int maxCount)
+{
+	unsigned int count = 0;
+	unsigned short number = 0;
+	int i = 0;
+
+	while ( (i < len) && (count < maxCount) )
+	{
+		number = buff[i++];
+		if ( (PARAM_INDEX_F0 <= number) && (PARAM_INDEX_F2 >= number) )
+		{
+			if (i >= len)
+			{
+				break;
+			}
+			number = ( (number - PARAM_INDEX_F0 + 1) << 8 ) | buff[i++];
+		}
+
+		if (i >= len)
+		{
+			break;
+		}
+
+		params[count].number = number;
+		params[count].value = buff[i++];
+		count++;
+	}
+
+	return (int) count;
+}
+
+/*!
+ * \brief mlsBarcodeParam_LoadCache read cached parameter values of the opened device
+ * \return
+ * - number of cached parameters
+ * - -1: no cache for this device
+ */
+int mlsBarcodeParam_LoadCache(mlsBarcodeReader *reader, mlsBarcodeParam *params, unsigned int maxCount)
+{
+	char path[PATH_MAX];
+	char line[64];
+	unsigned int number = 0;
+	unsigned int value = 0;
+	unsigned int count = 0;
+	FILE *file = NULL;
+
+	if (GetCachePath(reader, path, sizeof(path)))
+	{
+		return -1;
+	}
+
+	file = fopen(path, "r");
+	if (NULL == file)
+	{
+		return -1;
+	}
+
+	while ( (count < maxCount) && (NULL != fgets(line, sizeof(line), file)) )
+	{
+		if ( ('#' == line[0]) || (2 != sscanf(line, "%x %x", &number, &value)) )
+		{
+			continue;
+		}
+		params[count].number = (unsigned short) number;
+		params[count].value = (unsigned char) value;
+		count++;
+	}
+
+	fclose(file);
+
+	return (int) count;
+}
+
+/*!
+ * \brief mlsBarcodeParam_SaveCache replace cache file of the opened device
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+int mlsBarcodeParam_SaveCache(mlsBarcodeReader *reader, const mlsBarcodeParam *params, unsigned int count)
+{
+	char path[PATH_MAX];
+	char tmpPath[PATH_MAX + 4];
+	FILE *file = NULL;
+
+	if (GetCachePath(reader, path, sizeof(path)))
+	{
+		return EXIT_FAILURE;
+	}
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+	file = fopen(tmpPath, "w");
+	if (NULL == file)
+	{
+		LOG_ERRNO(__func__);
+		return EXIT_FAILURE;
+	}
+
+	fputs(CACHE_HEADER, file);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		fprintf(file, "%03x %02x\n", params[i].number, params[i].value);
+	}
+
+	// Replace atomically so a crash never leaves a half written cache
+	if ( (fclose(file)) || (rename(tmpPath, path)) )
+	{
+		LOG_ERRNO(__func__);
+		remove(tmpPath);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief GetCachePath cache file of the opened device: <cacheDir>/<device id>
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: cache disabled or device id unknown
+ */
+static int GetCachePath(mlsBarcodeReader *reader, char *path, size_t pathLen)
+{
+	char id[PATH_MAX];
+
+	if ( ('\0' == reader->cacheDir[0]) || (GetDeviceId(reader, id, sizeof(id))) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (snprintf(path, pathLen, "%s/%s", reader->cacheDir, id) >= (int) pathLen)
+	{
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief GetDeviceId stable identifier of the device: its /dev/serial/by-id name,
+ * which contains the USB serial number
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail, device has no serial id
+ */
+static int GetDeviceId(mlsBarcodeReader *reader, char *id, size_t idLen)
+{
+	char devPath[PATH_MAX];
+	char linkPath[PATH_MAX];
+	char target[PATH_MAX];
+	struct dirent *entry = NULL;
+	DIR *dir = NULL;
+
+	if (NULL == realpath(reader->name, devPath))
+	{
+		return EXIT_FAILURE;
+	}
+
+	dir = opendir(SERIAL_BY_ID_PATH);
+	while ( (NULL != dir) && (NULL != (entry = readdir(dir))) )
+	{
+		if ('.' == entry->d_name[0])
+		{
+			continue;
+		}
+		snprintf(linkPath, sizeof(linkPath), "%s/%s", SERIAL_BY_ID_PATH, entry->d_name);
+		if ( (NULL != realpath(linkPath, target)) && (0 == strcmp(target, devPath)) )
+		{
+			snprintf(id, idLen, "%s", entry->d_name);
+			closedir(dir);
+			return EXIT_SUCCESS;
+		}
+	}
+
+	if (NULL != dir)
+	{
+		closedir(dir);
+	}
+
+	// Node names are reused by whatever scanner is plugged next, its cache would not match
+	LOG_DEBUG("%s: no serial id for %s, parameter cache disabled", __func__, devPath);
+
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,189 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+#include <poll.h>
+#include <libgen.h>
+#include <sys/inotify.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define RECONNECT_MIN_MSEC		50
+#define RECONNECT_MAX_MSEC		5000
+#define DEV_DIR_PATH			"/dev"
+#define INOTIFY_BUFF_LEN		4096
+#define WATCH_MASK				(IN_CREATE | IN_ATTRIB | IN_MOVED_TO)
+
+static int WatchDevice(mlsBarcodeReader *reader);
+static int TryOpen(mlsBarcodeReader *reader);
+
+/*!
+ * \brief mlsBarcodeReader_SetAutoReconnect let reader thread re-open the scanner when it hangs up
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetAutoReconnect(mlsBarcodeReader *reader, int isEnabled)
+{
+	if (NULL == reader)
+	{
+		return EXIT_FAILURE;
+	}
+
+	reader->isAutoReconnect = isEnabled ? TRUE : FALSE;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_IsConnected check if scanner is currently opened
+ * \return
+ * - TRUE (1): opened
+ * - FALSE (0): closed or reconnecting
+ */
+int mlsBarcodeReader_IsConnected(mlsBarcodeReader *reader)
+{
+	assert(reader != NULL);
+
+	return (0 <= __atomic_load_n(&reader->fd, __ATOMIC_RELAXED)) ? TRUE : FALSE;
+}
+
+/*!
+ * \brief mlsBarcodeReader_Reconnect wait for device node to come back and open it again.
+ * Any change in the watched directories triggers an immediate attempt, the backoff
+ * timer covers nodes created before the watch and missed events.
+ * \return
+ * - EXIT_SUCCESS: scanner is opened again
+ * - EXIT_FAILURE: stopFd was signaled or watch failed
+ */
+int mlsBarcodeReader_Reconnect(mlsBarcodeReader *reader, int stopFd)
+{
+	char events[INOTIFY_BUFF_LEN] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd[2];
+	int delayMs = RECONNECT_MIN_MSEC;
+	int ret = EXIT_FAILURE;
+
+	assert(reader != NULL);
+
+	mlsBarcodeReader_Detach(reader);
+
+	pfd[0].fd = WatchDevice(reader);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = stopFd;
+	pfd[1].events = POLLIN;
+
+	while (TRUE)
+	{
+		if (0 > poll(pfd, 2, delayMs))
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			LOG_ERRNO(__func__);
+			break;
+		}
+
+		if (pfd[1].revents)
+		{
+			break;
+		}
+
+		if (pfd[0].revents & POLLIN)
+		{
+			// Content does not matter, only that something changed
+			while (0 < read(pfd[0].fd, events, sizeof(events)))
+			{
+			}
+		}
+		else
+		{
+			delayMs = (2 * delayMs < RECONNECT_MAX_MSEC) ? 2 * delayMs : RECONNECT_MAX_MSEC;
+		}
+
+		if (EXIT_SUCCESS == TryOpen(reader))
+		{
+			ret = EXIT_SUCCESS;
+			break;
+		}
+	}
+
+	if (0 <= pfd[0].fd)
+	{
+		close(pfd[0].fd);
+	}
+
+	return ret;
+}
+
+/*!
+ * \brief WatchDevice watch /dev and directory of the device path (e.g. /dev/serial/by-id)
+ * for created nodes or links and permission changes made by udev
+ * \return
+ * - inotify descriptor, non-blocking
+ * - -1: inotify not available, backoff timer only
+ */
+static int WatchDevice(mlsBarcodeReader *reader)
+{
+	char dir[MAX_DEV_NAME_LEN];
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (0 > fd)
+	{
+		LOG_ERRNO(__func__);
+		return -1;
+	}
+
+	inotify_add_watch(fd, DEV_DIR_PATH, WATCH_MASK);
+
+	// Parent of a by-id link is removed with the last device, /dev still catches its return
+	strcpy(dir, reader->name);
+	inotify_add_watch(fd, dirname(dir), WATCH_MASK);
+
+	return fd;
+}
+
+/*!
+ * \brief TryOpen open and configure scanner again if its node exists
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int TryOpen(mlsBarcodeReader *reader)
+{
+	int ret = EXIT_FAILURE;
+
+	if (access(reader->name, R_OK | W_OK))
+	{
+		return EXIT_FAILURE;
+	}
+
+	// Open_r releases the descriptor itself on failure
+	pthread_mutex_lock(&reader->ioLock);
+	ret = mlsBarcodeReader_Open_r(reader, reader->name);
+	pthread_mutex_unlock(&reader->ioLock);
+
+	if (EXIT_SUCCESS == ret)
+	{
+		COUNTER_ADD(reader, reopens, 1);
+		LOG_INFO("%s reconnected", reader->name);
+	}
+
+	return ret;
+}
@@ -0,0 +1,269 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "mlsBarcodeInternal.h"
+
+static int RingPop(mlsBarcodeRing *ring, mlsBarcodeRecord *record);
+
+/*!
+ * \brief mlsBarcodeReader_SetQueueSize enable decode queue of a reader context
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_SetQueueSize(mlsBarcodeReader *reader, unsigned int records)
+{
+	if ( (NULL == reader) || (NULL != reader->queue) )
+	{
+		LOG_ERROR("%s: queue must be sized before opening", __func__);
+		return EXIT_FAILURE;
+	}
+
+	reader->queueSize = records;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_TryPop take oldest barcode from decode queue without waiting
+ * \return
+ * - EXIT_SUCCESS: record is filled
+ * - EXIT_FAILURE: queue is empty or disabled
+ */
+char mlsBarcodeReader_TryPop(mlsBarcodeReader *reader, mlsBarcodeRecord *record)
+{
+	assert(reader != NULL);
+	assert(record != NULL);
+
+	if (NULL == reader->queue)
+	{
+		return EXIT_FAILURE;
+	}
+
+	return RingPop(reader->queue, record);
+}
+
+/*!
+ * \brief mlsBarcodeReader_Pop take oldest barcode from decode queue, waiting for one if empty
+ * \return
+ * - EXIT_SUCCESS: record is filled
+ * - EXIT_FAILURE: timeout, queue disabled or error
+ */
+char mlsBarcodeReader_Pop(mlsBarcodeReader *reader, mlsBarcodeRecord *record, int timeoutMs)
+{
+	mlsBarcodeRing *ring = NULL;
+	struct pollfd pfd;
+	uint64_t count = 0;
+	int waitMs = timeoutMs;
+	const int64_t deadline = mlsBarcode_GetTimeMs() + timeoutMs;
+	int ret = 0;
+
+	assert(reader != NULL);
+	assert(record != NULL);
+
+	ring = reader->queue;
+	if (NULL == ring)
+	{
+		return EXIT_FAILURE;
+	}
+
+	pfd.fd = ring->eventFd;
+	pfd.events = POLLIN;
+
+	while (RingPop(ring, record))
+	{
+		ret = poll(&pfd, 1, waitMs);
+		if (0 > ret)
+		{
+			if (EINTR != errno)
+			{
+				LOG_ERRNO(__func__);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (0 == ret)
+		{
+			return EXIT_FAILURE;
+		}
+		else
+		{
+			// Clear the counter, records pushed meanwhile are found by RingPop()
+			if (read(ring->eventFd, &count, sizeof(count)) < 0)
+			{
+				count = 0;
+			}
+		}
+
+		if (0 <= timeoutMs)
+		{
+			waitMs = (int) (deadline - mlsBarcode_GetTimeMs());
+			if (waitMs < 0)
+			{
+				waitMs = 0;
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_GetQueueFd descriptor which becomes readable when barcodes are queued
+ * \return
+ * - eventfd descriptor: Success
+ * - -1: queue is disabled
+ */
+int mlsBarcodeReader_GetQueueFd(mlsBarcodeReader *reader)
+{
+	assert(reader != NULL);
+
+	return (NULL != reader->queue) ? reader->queue->eventFd : -1;
+}
+
+/*!
+ * \brief mlsBarcodeRing_Create allocate queue and all its records
+ * \return
+ * - pointer to new queue: Success
+ * - NULL: Fail
+ */
+mlsBarcodeRing *mlsBarcodeRing_Create(unsigned int records)
+{
+	mlsBarcodeRing *ring = NULL;
+	uint32_t capacity = 1;
+
+	while (capacity < records)
+	{
+		capacity <<= 1;
+	}
+
+	if (posix_memalign((void **) &ring, CACHE_LINE_LEN, sizeof(*ring)))
+	{
+		LOG_ERRNO(__func__);
+		return NULL;
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->mask = capacity - 1;
+
+	ring->records = calloc(capacity, sizeof(*ring->records));
+	if (NULL == ring->records)
+	{
+		LOG_ERRNO(__func__);
+		free(ring);
+		return NULL;
+	}
+
+	ring->eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (0 > ring->eventFd)
+	{
+		LOG_ERRNO(__func__);
+		free(ring->records);
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+/*!
+ * \brief mlsBarcodeRing_Destroy free queue and its records
+ */
+void mlsBarcodeRing_Destroy(mlsBarcodeRing *ring)
+{
+	if (NULL == ring)
+	{
+		return;
+	}
+
+	close(ring->eventFd);
+	free(ring->records);
+	free(ring);
+}
+
+/*!
+ * \brief mlsBarcodeRing_Push copy barcode into next free record (producer side)
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: queue is full, barcode is dropped
+ */
+int mlsBarcodeRing_Push(mlsBarcodeRing *ring, const char *barcode, unsigned int length,
+		unsigned char symbology, const struct timespec *timestamp)
+{
+	const uint64_t wakeUp = 1;
+	const uint32_t tail = ring->tail;
+	mlsBarcodeRecord *record = NULL;
+
+	if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (length > MLS_BARCODE_MAX_LEN - 1)
+	{
+		length = MLS_BARCODE_MAX_LEN - 1;
+	}
+
+	record = &ring->records[tail & ring->mask];
+	record->length = length;
+	record->symbology = symbology;
+	record->timestamp = *timestamp;
+	memcpy(record->data, barcode, length);
+	record->data[length] = '\0';
+
+	// Publish record before waking consumer up
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (write(ring->eventFd, &wakeUp, sizeof(wakeUp)) < 0)
+	{
+		LOG_ERRNO(__func__);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief RingPop copy oldest record out and release its slot (consumer side)
+ * \return
+ * - EXIT_SUCCESS: record is filled
+ * - EXIT_FAILURE: queue is empty
+ */
+static int RingPop(mlsBarcodeRing *ring, mlsBarcodeRecord *record)
+{
+	const uint32_t head = ring->head;
+	const mlsBarcodeRecord *slot = NULL;
+
+	if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+	{
+		return EXIT_FAILURE;
+	}
+
+	slot = &ring->records[head & ring->mask];
+	record->length = slot->length;
+	record->symbology = slot->symbology;
+	record->timestamp = slot->timestamp;
+	memcpy(record->data, slot->data, slot->length + 1);
+
+	// Slot can be reused by producer from now on
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "mlsBarcodeInternal.h"
+
+#define COUNTERS_LEN		( sizeof(mlsBarcodeStats) / sizeof(unsigned long long) )
+
+/*!
+ * \brief mlsBarcodeReader_GetStats snapshot of protocol counters
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_GetStats(mlsBarcodeReader *reader, mlsBarcodeStats *stats)
+{
+	unsigned long long *from = NULL;
+	unsigned long long *to = NULL;
+
+	if ( (NULL == reader) || (NULL == stats) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	// All counters have the same type, no lock: writers may be updating them meanwhile
+	from = (unsigned long long *) &reader->stats;
+	to = (unsigned long long *) stats;
+	for (unsigned int i = 0; i < COUNTERS_LEN; i++)
+	{
+		to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_ResetStats set all protocol counters to 0
+ */
+void mlsBarcodeReader_ResetStats(mlsBarcodeReader *reader)
+{
+	unsigned long long *counters = NULL;
+
+	assert(reader != NULL);
+
+	counters = (unsigned long long *) &reader->stats;
+	for (unsigned int i = 0; i < COUNTERS_LEN; i++)
+	{
+		__atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,162 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "mlsBarcodeInternal.h"
+
+static void *ReaderThread(void *arg);
+
+/*!
+ * \brief mlsBarcodeReader_StartThread start a library owned thread which waits for
+ * scanner input and calls callback as soon as a barcode is received and ACKed.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_StartThread(mlsBarcodeReader *reader, mlsBarcodeReader_Callback callback, void *userData)
+{
+	int ret = 0;
+
+	assert(reader != NULL);
+
+	if ( (reader->isThreadRunning) || (0 > reader->fd) )
+	{
+		LOG_ERROR("%s: reader is not opened or thread is already running", __func__);
+		return EXIT_FAILURE;
+	}
+
+	mlsBarcodeReader_SetCallback(reader, callback, userData);
+
+	// Bytes seen by poll() may be taken by a command of another thread first: read must not block
+	if (mlsBarcode_SetNonBlocking(reader->fd, TRUE))
+	{
+		return EXIT_FAILURE;
+	}
+
+	reader->stopFd = eventfd(0, EFD_CLOEXEC);
+	if (0 > reader->stopFd)
+	{
+		LOG_ERRNO(__func__);
+		mlsBarcode_SetNonBlocking(reader->fd, FALSE);
+		return EXIT_FAILURE;
+	}
+
+	ret = pthread_create(&reader->thread, NULL, ReaderThread, reader);
+	if (ret)
+	{
+		errno = ret;
+		LOG_ERRNO(__func__);
+		close(reader->stopFd);
+		mlsBarcode_SetNonBlocking(reader->fd, FALSE);
+		return EXIT_FAILURE;
+	}
+
+	reader->isThreadRunning = TRUE;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeReader_StopThread stop reader thread and wait for it to exit
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeReader_StopThread(mlsBarcodeReader *reader)
+{
+	const uint64_t wakeUp = 1;
+
+	assert(reader != NULL);
+
+	if (! reader->isThreadRunning)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	if (write(reader->stopFd, &wakeUp, sizeof(wakeUp)) != sizeof(wakeUp))
+	{
+		LOG_ERRNO(__func__);
+		return EXIT_FAILURE;
+	}
+
+	pthread_join(reader->thread, NULL);
+	close(reader->stopFd);
+	reader->isThreadRunning = FALSE;
+
+	if (0 <= reader->fd)
+	{
+		mlsBarcode_SetNonBlocking(reader->fd, FALSE);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief ReaderThread wait for scanner input or stop request and dispatch decode events
+ */
+static void *ReaderThread(void *arg)
+{
+	mlsBarcodeReader *reader = arg;
+	struct pollfd pfd[2];
+	int ret = 0;
+
+	pfd[0].fd = reader->fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = reader->stopFd;
+	pfd[1].events = POLLIN;
+
+	while (TRUE)
+	{
+		ret = poll(pfd, 2, -1);
+		if (0 > ret)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			LOG_ERRNO(__func__);
+			break;
+		}
+
+		if (pfd[1].revents)
+		{
+			break;
+		}
+
+		if ( (pfd[0].revents & POLLIN) && (0 <= mlsBarcodeReader_ServiceInput(reader)) )
+		{
+			continue;
+		}
+
+		if (pfd[0].revents)
+		{
+			LOG_ERROR("%s hang up", reader->name);
+			if ( (! reader->isAutoReconnect) || (mlsBarcodeReader_Reconnect(reader, reader->stopFd)) )
+			{
+				break;
+			}
+			pfd[0].fd = reader->fd;
+			mlsBarcode_SetNonBlocking(reader->fd, TRUE);
+		}
+	}
+
+	return NULL;
+}
@@ -22,6 +22,7 @@ typedef unsigned char byte;
 #define SSI_STOP_SESSION					0xE5
 #define SSI_REQ_REVISION					0xA3
 #define SSI_PARAM_SEND						0xC6
+#define SSI_PARAM_REQUEST					0xC7
 #define SSI_CMD_ACK							0xD0
 #define SSI_CMD_NAK							0xD1
 #define SSI_CUSTOM_DEFAULTS					0x12
@@ -30,6 +31,7 @@ typedef unsigned char byte;
 #define SSI_PARAM_SEND						0xC6
 #define SSI_SCAN_ENABLE						0xE9
 #define SSI_SCAN_DISABLE					0xEA
+#define SSI_EVENT							0xF6
 
 // NAK Code
 #define NAK_RESEND							0x01
@@ -59,10 +61,20 @@ typedef unsigned char byte;
 #define PARAM_TRIGGER_AUTO					0x09
 #define PARAM_TRIGGER_AUTO_WITHLED			0x0A
 #define PARAM_DEC_TIMEOUT					0x88
+#define PARAM_BAUD_RATE						0x9C
+#define PARAM_BAUD_9600						0x06
+#define PARAM_BAUD_19200					0x07
+#define PARAM_BAUD_38400					0x08
+#define PARAM_BAUD_57600					0x0A
+#define PARAM_BAUD_115200					0x0B
 // PARAM_INDEX_Fx (x = 0, 1, 2)
 #define PARAM_INDEX_F0						0xF0
 #define PARAM_INDEX_F1						0xF1
 #define PARAM_INDEX_F2						0xF2
+#define PARAM_BEEP_DEFAULT					0x01	// beep code sent by ConfigSSI
+// Parameter number behind a PARAM_INDEX_Fx prefix, e.g. PARAM_EXT(PARAM_INDEX_F0, 0x00) = 0x100
+#define PARAM_EXT(prefix, x)				( (((prefix) - PARAM_INDEX_F0 + 1) << 8) | (x) )
+#define PARAM_NUMBER_MAX					PARAM_EXT(PARAM_INDEX_F2, 0xFF)
 
 // Package index
 #define INDEX_LEN							0
@@ -91,11 +103,11 @@ typedef unsigned char byte;
 #define MAX_PKG_LEN							257
 
 // Macro
-#define PKG_LEN(x)		(x[INDEX_LEN])
+#define PKG_LEN(x)		((x)[INDEX_LEN])
 
 // Error
 #define ECKSUM								2
-#define ENAK								0xA0
+#define ENAK								0xA0	// same as MLS_BARCODE_ENAK
 #define ENODEC								4
 
 #endif /* ssi_command_h */
@@ -0,0 +1,167 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ssiCodec.h"
+
+#define TRUE			1
+#define FALSE			0
+
+// Low byte of each 16 bits lane
+#define LANE_MASK		0x00FF00FF00FF00FFULL
+// 32 words: a lane gets at most 32 * 2 * 0xFF, the 4 lanes still add up below 0x10000
+#define BLOCK_WORDS		32
+
+static uint32_t SumBytes(const byte *data, unsigned int len);
+
+/*!
+ * \brief ssiCodec_Checksum 2's complement of the sum of len bytes, added word at a time
+ * \return 16 bits checksum
+ */
+uint16_t ssiCodec_Checksum(const byte *data, unsigned int len)
+{
+	return (uint16_t) (0x10000 - (SumBytes(data, len) & 0xFFFF));
+}
+
+/*!
+ * \brief ssiCodec_IsChecksumOK check 2 last bytes of a complete frame
+ * \return
+ * - TRUE: checksum is correct
+ * - FALSE: checksum is incorrect
+ */
+int ssiCodec_IsChecksumOK(const byte *pkg)
+{
+	return (SSI_FRAME_CKSUM(pkg) == ssiCodec_Checksum(pkg, PKG_LEN(pkg)));
+}
+
+/*!
+ * \brief ssiCodec_Encode build a frame with its checksum in pkg, which holds MAX_PKG_LEN bytes
+ * \return frame size, checksum included
+ */
+int ssiCodec_Encode(byte *pkg, byte opcode, byte source, byte status, const byte *data, byte dataLen)
+{
+	uint16_t checksum = 0;
+
+	assert(dataLen <= UINT8_MAX - SSI_HEADER_LEN);
+
+	pkg[INDEX_LEN] = SSI_HEADER_LEN;
+	pkg[INDEX_OPCODE] = opcode;
+	pkg[INDEX_SRC] = source;
+	pkg[INDEX_STAT] = status;
+
+	if ( (NULL != data) && (0 != dataLen) )
+	{
+		pkg[INDEX_LEN] += dataLen;
+		memcpy(&pkg[SSI_HEADER_LEN], data, dataLen);
+	}
+
+	checksum = ssiCodec_Checksum(pkg, PKG_LEN(pkg));
+	pkg[PKG_LEN(pkg)] = checksum >> 8;
+	pkg[PKG_LEN(pkg) + 1] = checksum & 0xFF;
+
+	return SSI_FRAME_LEN(pkg);
+}
+
+/*!
+ * \brief ssiCodec_SetStatus replace status of an encoded frame and update its checksum
+ */
+void ssiCodec_SetStatus(byte *pkg, byte status)
+{
+	// Sum changes by the status difference only, no need to add the frame again
+	uint16_t checksum = SSI_FRAME_CKSUM(pkg) + pkg[INDEX_STAT] - status;
+
+	pkg[INDEX_STAT] = status;
+	pkg[PKG_LEN(pkg)] = checksum >> 8;
+	pkg[PKG_LEN(pkg) + 1] = checksum & 0xFF;
+}
+
+/*!
+ * \brief ssiCodec_Split validate and cut back-to-back frames of buff in one pass
+ * \return number of frames filled
+ */
+int ssiCodec_Split(const byte *buff, int len, ssiFrame *frames, int maxFrames, int *consumed)
+{
+	int count = 0;
+	int offset = 0;
+	int skipped = 0;
+	int size = 0;
+
+	assert( (NULL != buff) || (0 == len) );
+	assert(consumed != NULL);
+
+	while ( (count < maxFrames) && (offset < len) )
+	{
+		if (PKG_LEN(&buff[offset]) < SSI_HEADER_LEN)
+		{
+			// Not a length byte, skip it to resynchronize
+			skipped++;
+			offset++;
+			continue;
+		}
+
+		size = SSI_FRAME_LEN(&buff[offset]);
+		if (len - offset < size)
+		{
+			break;
+		}
+
+		frames[count].pkg = &buff[offset];
+		frames[count].offset = offset;
+		frames[count].size = size;
+		frames[count].skipped = skipped;
+		frames[count].isChecksumOK = ssiCodec_IsChecksumOK(&buff[offset]);
+		count++;
+
+		skipped = 0;
+		offset += size;
+	}
+
+	*consumed = offset;
+	return count;
+}
+
+/*!
+ * \brief SumBytes add len bytes, 8 at a time in 4 lanes of 16 bits
+ * \return sum, only low 16 bits are exact for long inputs
+ */
+static uint32_t SumBytes(const byte *data, unsigned int len)
+{
+	uint64_t word = 0;
+	uint64_t lanes = 0;
+	uint32_t sum = 0;
+	unsigned int i = 0;
+	unsigned int words = 0;
+
+	while (len - i >= sizeof(word))
+	{
+		lanes = 0;
+		for (words = 0; (words < BLOCK_WORDS) && (len - i >= sizeof(word)); words++)
+		{
+			// memcpy: frames start at any offset of the receive buffer
+			memcpy(&word, &data[i], sizeof(word));
+			lanes += (word & LANE_MASK) + ((word >> 8) & LANE_MASK);
+			i += sizeof(word);
+		}
+		// Top lane of the product is the sum of the 4 lanes
+		sum += (uint32_t) ((lanes * 0x0001000100010001ULL) >> 48);
+	}
+
+	for ( ; i < len; i++)
+	{
+		sum += data[i];
+	}
+
+	return sum;
+}
@@ -0,0 +1,77 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+#ifndef SSICODEC_H
+#define SSICODEC_H
+
+#include <stdint.h>
+
+#include "ssi.h"
+
+/*
+ * SSI framing without I/O: [len][opcode][source][status][data...][checksum hi][checksum lo]
+ * len counts header and data, checksum is 2's complement of the sum of those len bytes.
+ * Used by the reader, the simulator and the tools alike.
+ */
+
+#define SSI_FRAME_LEN(pkg)			(PKG_LEN(pkg) + SSI_CKSUM_LEN)
+#define SSI_FRAME_CKSUM(pkg)		((uint16_t) (((pkg)[PKG_LEN(pkg)] << 8) | (pkg)[PKG_LEN(pkg) + 1]))
+#define SSI_IS_CONTINUE(pkg)		(STAT_CONTINUATION & (pkg)[INDEX_STAT])
+
+/*!
+ * \brief ssiFrame view of one complete frame inside a caller's buffer, nothing is copied
+ */
+typedef struct _ssiFrame
+{
+	const byte *pkg;		// length byte of the frame
+	int offset;				// of pkg from start of the split buffer
+	int size;				// whole frame, checksum included
+	int skipped;			// bytes dropped just before this frame to resynchronize
+	int isChecksumOK;
+} ssiFrame;
+
+/*!
+ * \brief ssiCodec_Checksum 2's complement of the sum of len bytes, added word at a time
+ * \return 16 bits checksum
+ */
+uint16_t ssiCodec_Checksum(const byte *data, unsigned int len);
+
+/*!
+ * \brief ssiCodec_IsChecksumOK check 2 last bytes of a complete frame
+ * \return
+ * - TRUE: checksum is correct
+ * - FALSE: checksum is incorrect
+ */
+int ssiCodec_IsChecksumOK(const byte *pkg);
+
+/*!
+ * \brief ssiCodec_Encode build a frame with its checksum in pkg, which holds MAX_PKG_LEN bytes
+ * \return frame size, checksum included
+ */
+int ssiCodec_Encode(byte *pkg, byte opcode, byte source, byte status, const byte *data, byte dataLen);
+
+/*!
+ * \brief ssiCodec_SetStatus replace status of an encoded frame and update its checksum
+ */
+void ssiCodec_SetStatus(byte *pkg, byte status);
+
+/*!
+ * \brief ssiCodec_Split validate and cut back-to-back frames of buff in one pass.
+ * Bytes which can not be a length byte are dropped to resynchronize. Frames with a wrong
+ * checksum are returned too, with isChecksumOK cleared. Stops at an incomplete frame or
+ * when maxFrames are found.
+ * \param consumed set to number of bytes handled: complete frames and dropped bytes
+ * \return number of frames filled
+ */
+int ssiCodec_Split(const byte *buff, int len, ssiFrame *frames, int maxFrames, int *consumed);
+
+#endif /* SSICODEC_H */
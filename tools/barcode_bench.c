@@ -0,0 +1,369 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+// Micro-benchmarks of the SSI codec and read path, run with "make bench".
+// Numbers are meant for before/after comparison on the same machine.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "mlsBarcodeInternal.h"
+#include "mlsBarcodeSim.h"
+#include "ssiCodec.h"
+
+#define BENCH_SYMBOLOGY		MLS_SYMBOLOGY_QRCODE
+#define SHORT_BARCODE_LEN	12
+#define LONG_BARCODE_LEN	1000		// 4 DEC_DATA packets
+#define FRAMES_PER_FEED		64
+#define DEC_CHUNK_LEN		(UINT8_MAX - SSI_HEADER_LEN - 1)	// data bytes per DEC_DATA packet
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocCount = 0;
+static volatile uint16_t sink = 0;		// keeps results of pure functions alive
+
+typedef struct benchCounters
+{
+	int64_t ns;
+	unsigned long allocs;
+	unsigned long long syscalls;
+} benchCounters;
+
+static int64_t GetTimeNs(void);
+static unsigned long long GetSyscalls(void);
+static void StartCounters(benchCounters *counters);
+static void StopCounters(benchCounters *counters);
+static void Report(const char *name, const benchCounters *counters, unsigned long count, const char *unit);
+static int MakeDecodeFrames(byte *buff, const char *barcode, int length);
+static void BenchChecksum(unsigned long iterations);
+static void BenchEncode(unsigned long iterations);
+static void BenchSplit(unsigned long iterations);
+static void BenchParse(unsigned long iterations, int barcodeLen, const char *name);
+static int BenchRoundTrip(unsigned long iterations);
+
+// Count allocations of the whole process, library included
+void *malloc(size_t size)
+{
+	__atomic_fetch_add(&allocCount, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	__atomic_fetch_add(&allocCount, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&allocCount, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long scale = 1;
+
+	if (1 < argc)
+	{
+		scale = strtoul(argv[1], NULL, 0);
+		if (0 == scale)
+		{
+			printf("Usage: %s [scale]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%-38s %12s %16s %14s\n", "benchmark", "ns/unit", "rw syscalls/unit", "allocs/unit");
+
+	BenchChecksum(scale * 2000000);
+	BenchEncode(scale * 2000000);
+	BenchSplit(scale * 20000);
+	BenchParse(scale * 20000, SHORT_BARCODE_LEN, "parse 1 packet/barcode");
+	BenchParse(scale * 5000, LONG_BARCODE_LEN, "reassemble 4 packets/barcode");
+
+	return BenchRoundTrip(scale * 200);
+}
+
+static int64_t GetTimeNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*!
+ * \brief GetSyscalls read + write system calls made so far by calling thread
+ */
+static unsigned long long GetSyscalls(void)
+{
+	char buff[512];
+	unsigned long long syscr = 0;
+	unsigned long long syscw = 0;
+	char *field = NULL;
+	ssize_t len = 0;
+	int fd = open("/proc/thread-self/io", O_RDONLY);
+
+	if (0 > fd)
+	{
+		return 0;
+	}
+	len = read(fd, buff, sizeof(buff) - 1);
+	close(fd);
+	if (0 >= len)
+	{
+		return 0;
+	}
+	buff[len] = '\0';
+
+	field = strstr(buff, "syscr:");
+	if (NULL != field)
+	{
+		syscr = strtoull(field + 6, NULL, 10);
+	}
+	field = strstr(buff, "syscw:");
+	if (NULL != field)
+	{
+		syscw = strtoull(field + 6, NULL, 10);
+	}
+
+	return syscr + syscw;
+}
+
+static void StartCounters(benchCounters *counters)
+{
+	counters->syscalls = GetSyscalls();
+	counters->allocs = __atomic_load_n(&allocCount, __ATOMIC_RELAXED);
+	counters->ns = GetTimeNs();
+}
+
+static void StopCounters(benchCounters *counters)
+{
+	counters->ns = GetTimeNs() - counters->ns;
+	counters->allocs = __atomic_load_n(&allocCount, __ATOMIC_RELAXED) - counters->allocs;
+	// The read of /proc itself is counted once
+	counters->syscalls = GetSyscalls() - counters->syscalls - 1;
+}
+
+static void Report(const char *name, const benchCounters *counters, unsigned long count, const char *unit)
+{
+	char label[64];
+
+	snprintf(label, sizeof(label), "%s (%s)", name, unit);
+	printf("%-38s %12.1f %16.2f %14.2f\n", label, (double) counters->ns / count,
+			(double) counters->syscalls / count, (double) counters->allocs / count);
+}
+
+/*!
+ * \brief MakeDecodeFrames encode barcode as scanner DEC_DATA packages with continuation status
+ * \return number of bytes written to buff
+ */
+static int MakeDecodeFrames(byte *buff, const char *barcode, int length)
+{
+	byte data[UINT8_MAX];
+	int len = 0;
+	int offset = 0;
+	int partLen = 0;
+	do
+	{
+		partLen = (length - offset > DEC_CHUNK_LEN) ? DEC_CHUNK_LEN : length - offset;
+		data[0] = BENCH_SYMBOLOGY;
+		memcpy(&data[1], &barcode[offset], partLen);
+
+		len += ssiCodec_Encode(&buff[len], SSI_DEC_DATA, 0,
+				(offset + partLen < length) ? STAT_CONTINUATION : SSI_DEFAULT_STATUS, data, partLen + 1);
+		offset += partLen;
+	} while (offset < length);
+
+	return len;
+}
+
+static void BenchChecksum(unsigned long iterations)
+{
+	byte pkg[MAX_PKG_LEN];
+	byte data[200];
+	benchCounters counters;
+
+	memset(data, 'A', sizeof(data));
+	ssiCodec_Encode(pkg, SSI_DEC_DATA, 0, SSI_DEFAULT_STATUS, data, sizeof(data));
+
+	StartCounters(&counters);
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		pkg[SSI_HEADER_LEN] = (byte) i;
+		sink += ssiCodec_Checksum(pkg, PKG_LEN(pkg));
+	}
+	StopCounters(&counters);
+
+	Report("checksum 204B", &counters, iterations, "frame");
+}
+
+static void BenchEncode(unsigned long iterations)
+{
+	byte pkg[MAX_PKG_LEN];
+	byte param[10] = { PARAM_BEEP_NONE, PARAM_B_DEC_FORMAT, ENABLE, PARAM_B_SW_ACK, ENABLE,
+			PARAM_B_SCAN_PARAM, DISABLE, PARAM_TRIGGER_MODE, PARAM_TRIGGER_HOST, 0 };
+	benchCounters counters;
+
+	StartCounters(&counters);
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		param[9] = (byte) i;
+		sink += ssiCodec_Encode(pkg, SSI_PARAM_SEND, SSI_HOST, SSI_DEFAULT_STATUS, param, sizeof(param));
+	}
+	StopCounters(&counters);
+
+	Report("encode 10B param", &counters, iterations, "frame");
+}
+
+/*!
+ * \brief BenchSplit validate and cut a buffer of back-to-back full size DEC_DATA frames
+ */
+static void BenchSplit(unsigned long iterations)
+{
+	static byte stream[FRAMES_PER_FEED * MAX_PKG_LEN];
+	static char barcode[FRAMES_PER_FEED * DEC_CHUNK_LEN];
+	ssiFrame frames[FRAMES_PER_FEED];
+	benchCounters counters;
+	int len = 0;
+	int consumed = 0;
+	unsigned long count = 0;
+
+	memset(barcode, 'A', sizeof(barcode));
+	len = MakeDecodeFrames(stream, barcode, sizeof(barcode));
+
+	StartCounters(&counters);
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		count += ssiCodec_Split(stream, len, frames, FRAMES_PER_FEED, &consumed);
+		sink += frames[FRAMES_PER_FEED - 1].isChecksumOK;
+	}
+	StopCounters(&counters);
+
+	Report("split+verify 64 x 255B", &counters, count, "frame");
+	printf("%-38s %12.1f\n", "split+verify throughput (MB/s)", (double) len * iterations * 1000.0 / counters.ns);
+}
+
+/*!
+ * \brief BenchParse feed encoded barcodes to a reader without device, ACKs go to /dev/null
+ */
+static void BenchParse(unsigned long iterations, int barcodeLen, const char *name)
+{
+	byte *stream = NULL;
+	char barcode[LONG_BARCODE_LEN];
+	mlsBarcodeReader *reader = mlsBarcodeReader_Create();
+	benchCounters counters;
+	int frameLen = 0;
+	int framesPerBarcode = (barcodeLen + UINT8_MAX - SSI_HEADER_LEN - 2) / (UINT8_MAX - SSI_HEADER_LEN - 1);
+	int barcodesPerFeed = FRAMES_PER_FEED / framesPerBarcode;
+	unsigned long decodes = 0;
+
+	if (NULL == reader)
+	{
+		return;
+	}
+
+	for (int i = 0; i < barcodeLen; i++)
+	{
+		barcode[i] = 'A' + (i % 26);
+	}
+	stream = malloc(barcodesPerFeed * (framesPerBarcode * MAX_PKG_LEN));
+	for (int i = 0; i < barcodesPerFeed; i++)
+	{
+		frameLen += MakeDecodeFrames(&stream[frameLen], barcode, barcodeLen);
+	}
+
+	reader->fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	StartCounters(&counters);
+	for (unsigned long i = 0; i < iterations; i += barcodesPerFeed)
+	{
+		decodes += mlsBarcodeReader_FeedInput(reader, stream, frameLen);
+	}
+	StopCounters(&counters);
+
+	// Every package is ACKed with one write
+	Report(name, &counters, decodes * framesPerBarcode, "frame");
+
+	close(reader->fd);
+	reader->fd = -1;
+	mlsBarcodeReader_Destroy(reader);
+	free(stream);
+}
+
+/*!
+ * \brief BenchRoundTrip START_SESSION, decode and ACK against the pty simulator
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int BenchRoundTrip(unsigned long iterations)
+{
+	char barcode[SHORT_BARCODE_LEN];
+	char buff[MLS_BARCODE_MAX_LEN];
+	mlsBarcodeSim *sim = mlsBarcodeSim_Create();
+	mlsBarcodeReader *reader = mlsBarcodeReader_Create();
+	mlsBarcodeCommand startSession = { .opcode = SSI_START_SESSION };
+	benchCounters counters;
+	unsigned long scans = 0;
+	int ret = EXIT_FAILURE;
+
+	if ( (NULL == sim) || (NULL == reader) || (mlsBarcodeSim_Start(sim)) )
+	{
+		goto EXIT;
+	}
+
+	memset(barcode, 'A', sizeof(barcode));
+	mlsBarcodeSim_SetDecodeEvent(sim, FALSE);
+	mlsBarcodeSim_SetSessionBarcode(sim, BENCH_SYMBOLOGY, barcode, sizeof(barcode));
+
+	if (mlsBarcodeReader_Open_r(reader, (char *) mlsBarcodeSim_GetPath(sim)))
+	{
+		goto EXIT;
+	}
+
+	StartCounters(&counters);
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		if ( (EXIT_SUCCESS == mlsBarcodeReader_SendBatch(reader, &startSession, 1))
+				&& (sizeof(barcode) == mlsBarcodeReader_ReadDataMs(reader, buff, sizeof(buff), 1000)) )
+		{
+			scans++;
+		}
+	}
+	StopCounters(&counters);
+
+	if (scans)
+	{
+		Report("ReadData round trip pty", &counters, scans, "scan");
+	}
+	if (scans != iterations)
+	{
+		printf("%lu of %lu scans failed\n", iterations - scans, iterations);
+		goto EXIT;
+	}
+	ret = EXIT_SUCCESS;
+
+EXIT:
+	mlsBarcodeReader_Destroy(reader);
+	mlsBarcodeSim_Destroy(sim);
+	return ret;
+}
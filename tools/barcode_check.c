@@ -0,0 +1,445 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+// Regression checks run by "make check": multi-packet reassembly bounds and
+// retransmit/duplicate handling, driven through the simulator.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+
+#include "mlsBarcode.h"
+#include "mlsBarcodeSim.h"
+#include "ssi.h"
+
+#define TRUE				1
+#define FALSE				0
+#define CHECK_SYMBOLOGY		MLS_SYMBOLOGY_QRCODE
+#define LONG_BARCODE_LEN	1000		// 4 DEC_DATA packets
+#define SHORT_BUFF_LEN		100
+#define GUARD_LEN			16
+#define OVERSIZE_LEN		(MLS_BARCODE_MAX_LEN + 500)
+#define READ_TIMEOUT_MSEC	1000
+#define SCAN_DELAY_USEC		20000		// lets the read start before the scan
+
+#define CHECK(cond) \
+	do { \
+		if (! (cond)) \
+		{ \
+			printf("FAIL %s:%d: %s\n", __func__, __LINE__, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+typedef struct callbackResult
+{
+	unsigned int count;
+	unsigned int length;
+	unsigned int truncatedLen;
+	int isIntact;
+} callbackResult;
+
+static unsigned int failures = 0;
+static char barcode[OVERSIZE_LEN];
+
+static int ReadSession(mlsBarcodeReader *reader, mlsBarcodeSim *sim, unsigned int length, char *buff, int buffLen);
+static void *ScanThread(void *arg);
+static int ReadScan(mlsBarcodeReader *reader, mlsBarcodeSim *sim, char *buff, int buffLen);
+static void *ScanShortThread(void *arg);
+static void *ScanThread(void *arg)
+{
+	usleep(SCAN_DELAY_USEC);
+	mlsBarcodeSim_Scan(arg, CHECK_SYMBOLOGY, barcode, LONG_BARCODE_LEN);
+
+	return NULL;
+}
+
+static void *ScanShortThread(void *arg)
+{
+	mlsBarcodeSim_Scan(arg, CHECK_SYMBOLOGY, barcode, SHORT_BUFF_LEN / 2);
+
+	return NULL;
+}
+
+/*!
+ * \brief ReadScan read a barcode the simulator emits packet by packet, each one
+ * waiting for its ACK like a real decoder; faults apply to the package they hit
+ * \return same as mlsBarcodeReader_ReadDataMs()
+ */
+static int ReadScan(mlsBarcodeReader *reader, mlsBarcodeSim *sim, char *buff, int buffLen)
+{
+	pthread_t thread;
+	int ret = 0;
+
+	if (pthread_create(&thread, NULL, ScanThread, sim))
+	{
+		return 0;
+	}
+
+	ret = (int) mlsBarcodeReader_ReadDataMs(reader, buff, buffLen, READ_TIMEOUT_MSEC);
+	pthread_join(thread, NULL);
+
+	return ret;
+}
+
+static void OnBarcode(mlsBarcodeReader *reader, const char *data, unsigned int length,
+		const struct timespec *timestamp, void *userData);
+static void CheckReassembly(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static void CheckTruncation(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static void CheckOversize(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static void CheckRetransmit(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static void CheckLostReply(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static void CheckScannerResend(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static void CheckBatchOrder(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static void CheckDecodeDuringCommand(mlsBarcodeReader *reader, mlsBarcodeSim *sim);
+static int CountThreads(void);
+static void CheckDestroyReconnecting(void);
+
+int main(void)
+{
+	mlsBarcodeSim *sim = mlsBarcodeSim_Create();
+	mlsBarcodeReader *reader = mlsBarcodeReader_Create();
+
+	mlsBarcodeLog_SetLevel(MLS_LOG_NONE);
+
+	for (unsigned int i = 0; i < sizeof(barcode); i++)
+	{
+		barcode[i] = 'A' + i % 26;
+	}
+
+	if ( (NULL == sim) || (NULL == reader) || (mlsBarcodeSim_Start(sim)) )
+	{
+		printf("FAIL: simulator\n");
+		return EXIT_FAILURE;
+	}
+
+	mlsBarcodeSim_SetDecodeEvent(sim, FALSE);
+	if (mlsBarcodeReader_Open_r(reader, (char *) mlsBarcodeSim_GetPath(sim)))
+	{
+		printf("FAIL: open %s\n", mlsBarcodeSim_GetPath(sim));
+		return EXIT_FAILURE;
+	}
+
+	CheckReassembly(reader, sim);
+	CheckTruncation(reader, sim);
+	CheckRetransmit(reader, sim);
+	CheckLostReply(reader, sim);
+	CheckScannerResend(reader, sim);
+	CheckBatchOrder(reader, sim);
+	CheckDecodeDuringCommand(reader, sim);
+	CheckDestroyReconnecting();
+	// Last: leaves the reader thread running
+	CheckOversize(reader, sim);
+
+	mlsBarcodeReader_Destroy(reader);
+	mlsBarcodeSim_Destroy(sim);
+
+	printf("%u check(s) failed\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*!
+ * \brief ReadSession let simulator emit the first length bytes of barcode on START_SESSION
+ * and read it with mlsBarcodeReader_ReadDataMs()
+ * \return same as mlsBarcodeReader_ReadDataMs()
+ */
+static int ReadSession(mlsBarcodeReader *reader, mlsBarcodeSim *sim, unsigned int length, char *buff, int buffLen)
+{
+	mlsBarcodeCommand startSession = { .opcode = SSI_START_SESSION };
+
+	mlsBarcodeSim_SetSessionBarcode(sim, CHECK_SYMBOLOGY, barcode, length);
+	if (mlsBarcodeReader_SendBatch(reader, &startSession, 1))
+	{
+		return 0;
+	}
+
+	return (int) mlsBarcodeReader_ReadDataMs(reader, buff, buffLen, READ_TIMEOUT_MSEC);
+}
+
+static void OnBarcode(mlsBarcodeReader *reader, const char *data, unsigned int length,
+		const struct timespec *timestamp, void *userData)
+{
+	callbackResult *result = userData;
+
+	result->length = length;
+	result->truncatedLen = mlsBarcodeReader_GetTruncatedLen(reader);
+	result->isIntact = (0 == memcmp(data, barcode, length));
+	__atomic_store_n(&result->count, result->count + 1, __ATOMIC_RELEASE);
+}
+
+// Continuation packets are joined in order, nothing left for the next read
+static void CheckReassembly(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	char buff[MLS_BARCODE_MAX_LEN];
+
+	CHECK(LONG_BARCODE_LEN == ReadSession(reader, sim, LONG_BARCODE_LEN, buff, sizeof(buff)));
+	CHECK(0 == memcmp(buff, barcode, LONG_BARCODE_LEN));
+	CHECK(0 == mlsBarcodeReader_GetTruncatedLen(reader));
+
+	CHECK(1 == ReadSession(reader, sim, 1, buff, sizeof(buff)));
+	CHECK(barcode[0] == buff[0]);
+}
+
+// Caller buffer bounds reassembly, the rest is counted and the next barcode is whole
+static void CheckTruncation(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	char buff[SHORT_BUFF_LEN + GUARD_LEN];
+	char guard[GUARD_LEN];
+
+	memset(guard, 0x5A, sizeof(guard));
+	memcpy(&buff[SHORT_BUFF_LEN], guard, sizeof(guard));
+
+	CHECK(SHORT_BUFF_LEN == ReadSession(reader, sim, LONG_BARCODE_LEN, buff, SHORT_BUFF_LEN));
+	CHECK(0 == memcmp(buff, barcode, SHORT_BUFF_LEN));
+	CHECK(0 == memcmp(&buff[SHORT_BUFF_LEN], guard, sizeof(guard)));
+	CHECK(LONG_BARCODE_LEN - SHORT_BUFF_LEN == mlsBarcodeReader_GetTruncatedLen(reader));
+
+	CHECK(SHORT_BUFF_LEN / 2 == ReadSession(reader, sim, SHORT_BUFF_LEN / 2, buff, SHORT_BUFF_LEN));
+	CHECK(0 == memcmp(buff, barcode, SHORT_BUFF_LEN / 2));
+	CHECK(0 == mlsBarcodeReader_GetTruncatedLen(reader));
+}
+
+// Reader thread reassembles into its own buffer, bounded by MLS_BARCODE_MAX_LEN
+static void CheckOversize(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	callbackResult result = { 0 };
+
+	if (mlsBarcodeReader_StartThread(reader, OnBarcode, &result))
+	{
+		CHECK(! "reader thread started");
+		return;
+	}
+
+	CHECK(EXIT_SUCCESS == mlsBarcodeSim_Scan(sim, CHECK_SYMBOLOGY, barcode, OVERSIZE_LEN));
+	for (int i = 0; (i < READ_TIMEOUT_MSEC) && (0 == __atomic_load_n(&result.count, __ATOMIC_ACQUIRE)); i++)
+	{
+		usleep(1000);
+	}
+
+	CHECK(1 == result.count);
+	CHECK(MLS_BARCODE_MAX_LEN - 1 == result.length);
+	CHECK(OVERSIZE_LEN - (MLS_BARCODE_MAX_LEN - 1) == result.truncatedLen);
+	CHECK(result.isIntact);
+
+	mlsBarcodeReader_StopThread(reader);
+}
+
+// NAK RESEND is answered by a resend with the retransmit bit, run once by the scanner
+static void CheckRetransmit(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	mlsBarcodeStats before;
+	mlsBarcodeStats after;
+	mlsBarcodeSimStats simBefore;
+	mlsBarcodeSimStats simAfter;
+
+	mlsBarcodeReader_GetStats(reader, &before);
+	mlsBarcodeSim_GetStats(sim, &simBefore);
+	mlsBarcodeSim_InjectNAK(sim, 2, NAK_RESEND);
+
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_Disable_r(reader));
+
+	mlsBarcodeReader_GetStats(reader, &after);
+	mlsBarcodeSim_GetStats(sim, &simAfter);
+	CHECK(2 == after.retransTx - before.retransTx);
+	CHECK(2 == after.nakResend - before.nakResend);
+	CHECK(1 == simAfter.commandsRun - simBefore.commandsRun);
+	CHECK(! mlsBarcodeSim_IsScanEnabled(sim));
+
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_Enable_r(reader));
+	CHECK(mlsBarcodeSim_IsScanEnabled(sim));
+}
+
+// Command run but its ACK lost: the resend is a duplicate and must not run again
+static void CheckLostReply(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	mlsBarcodeStats before;
+	mlsBarcodeStats after;
+	mlsBarcodeSimStats simBefore;
+	mlsBarcodeSimStats simAfter;
+
+	mlsBarcodeReader_GetStats(reader, &before);
+	mlsBarcodeSim_GetStats(sim, &simBefore);
+	mlsBarcodeSim_InjectLostReply(sim, 1);
+
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_Disable_r(reader));
+
+	mlsBarcodeReader_GetStats(reader, &after);
+	mlsBarcodeSim_GetStats(sim, &simAfter);
+	CHECK(1 == after.retransTx - before.retransTx);
+	CHECK(1 == simAfter.commandsRun - simBefore.commandsRun);
+	CHECK(! mlsBarcodeSim_IsScanEnabled(sim));
+
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_Enable_r(reader));
+}
+
+// Scanner resends of a package already handled are ACKed and dropped, corrupted ones are NAKed
+static void CheckScannerResend(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	char buff[MLS_BARCODE_MAX_LEN];
+	mlsBarcodeStats before;
+	mlsBarcodeStats after;
+
+	mlsBarcodeReader_GetStats(reader, &before);
+	mlsBarcodeSim_InjectDuplicate(sim, 2);
+	CHECK(LONG_BARCODE_LEN == ReadScan(reader, sim, buff, sizeof(buff)));
+	CHECK(0 == memcmp(buff, barcode, LONG_BARCODE_LEN));
+	CHECK(0 == mlsBarcodeReader_ReadDataMs(reader, buff, sizeof(buff), READ_TIMEOUT_MSEC / 5));
+	mlsBarcodeReader_GetStats(reader, &after);
+	CHECK(2 == after.duplicatesRx - before.duplicatesRx);
+
+	before = after;
+	mlsBarcodeSim_InjectChecksumError(sim, 2);
+	CHECK(LONG_BARCODE_LEN == ReadScan(reader, sim, buff, sizeof(buff)));
+	CHECK(0 == memcmp(buff, barcode, LONG_BARCODE_LEN));
+	mlsBarcodeReader_GetStats(reader, &after);
+	CHECK(2 == after.nakTx - before.nakTx);
+	CHECK(0 == after.duplicatesRx - before.duplicatesRx);
+}
+
+// NAK RESEND or lost reply in a batch: only that command is resent, nothing runs twice
+static void CheckBatchOrder(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	mlsBarcodeCommand rearm[] = {
+		{ .opcode = SSI_SCAN_DISABLE },
+		{ .opcode = SSI_FLUSH_QUEUE },
+		{ .opcode = SSI_SCAN_ENABLE }
+	};
+	const unsigned int count = sizeof(rearm) / sizeof(*rearm);
+	mlsBarcodeStats before;
+	mlsBarcodeStats after;
+	mlsBarcodeSimStats simBefore;
+	mlsBarcodeSimStats simAfter;
+
+	// First command NAKed: resent after the others, so it runs last
+	mlsBarcodeReader_GetStats(reader, &before);
+	mlsBarcodeSim_GetStats(sim, &simBefore);
+	mlsBarcodeSim_InjectNAK(sim, 1, NAK_RESEND);
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_SendBatch(reader, rearm, count));
+	mlsBarcodeReader_GetStats(reader, &after);
+	mlsBarcodeSim_GetStats(sim, &simAfter);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		CHECK(EXIT_SUCCESS == rearm[i].result);
+	}
+	CHECK(1 == after.retransTx - before.retransTx);
+	CHECK(count == simAfter.commandsRun - simBefore.commandsRun);
+	CHECK(! mlsBarcodeSim_IsScanEnabled(sim));
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_Enable_r(reader));
+
+	// First command run without reply: the following replies shift onto the command before
+	// theirs, the last command seems unanswered and its resend is dropped as duplicate
+	mlsBarcodeReader_GetStats(reader, &before);
+	mlsBarcodeSim_GetStats(sim, &simBefore);
+	mlsBarcodeSim_InjectLostReply(sim, 1);
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_SendBatch(reader, rearm, count));
+	mlsBarcodeReader_GetStats(reader, &after);
+	mlsBarcodeSim_GetStats(sim, &simAfter);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		CHECK(EXIT_SUCCESS == rearm[i].result);
+	}
+	CHECK(1 == after.retransTx - before.retransTx);
+	CHECK(count == simAfter.commandsRun - simBefore.commandsRun);
+	CHECK(mlsBarcodeSim_IsScanEnabled(sim));
+}
+
+// Barcode completed while a command waits for its reply is ACKed, then returned by the next read
+static void CheckDecodeDuringCommand(mlsBarcodeReader *reader, mlsBarcodeSim *sim)
+{
+	char buff[MLS_BARCODE_MAX_LEN];
+	mlsBarcodeResult results[2];
+	pthread_t thread;
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		memset(buff, 0, sizeof(buff));
+		if (pthread_create(&thread, NULL, ScanShortThread, sim))
+		{
+			CHECK(! "scan thread started");
+			return;
+		}
+		usleep(SCAN_DELAY_USEC);
+		CHECK(EXIT_SUCCESS == mlsBarcodeReader_Enable_r(reader));
+		pthread_join(thread, NULL);
+
+		// No wait: the barcode must already be in the reader
+		if (0 == mode)
+		{
+			CHECK(SHORT_BUFF_LEN / 2 == mlsBarcodeReader_ReadDataMs(reader, buff, sizeof(buff), 0));
+		}
+		else if (1 == mode)
+		{
+			CHECK(EXIT_SUCCESS == mlsBarcodeReader_ReadResult(reader, results, buff, sizeof(buff), 0));
+			CHECK( (SHORT_BUFF_LEN / 2 == results[0].length) && (CHECK_SYMBOLOGY == results[0].symbology) );
+		}
+		else
+		{
+			CHECK(1 == mlsBarcodeReader_ReadStream(reader, results, 2, buff, sizeof(buff), 0));
+			CHECK( (SHORT_BUFF_LEN / 2 == results[0].length) && (0 == results[0].truncatedLen) );
+		}
+		CHECK(0 == memcmp(buff, barcode, SHORT_BUFF_LEN / 2));
+	}
+}
+
+static int CountThreads(void)
+{
+	DIR *dir = opendir("/proc/self/task");
+	struct dirent *entry = NULL;
+	int count = 0;
+
+	while ( (NULL != dir) && (NULL != (entry = readdir(dir))) )
+	{
+		if ('.' != entry->d_name[0])
+		{
+			count++;
+		}
+	}
+	if (NULL != dir)
+	{
+		closedir(dir);
+	}
+
+	return count;
+}
+
+// Scanner gone with auto-reconnect on: destroying the reader stops its reconnecting thread
+static void CheckDestroyReconnecting(void)
+{
+	const int threads = CountThreads();
+	mlsBarcodeSim *sim = mlsBarcodeSim_Create();
+	mlsBarcodeReader *reader = mlsBarcodeReader_Create();
+
+	if ( (NULL == sim) || (NULL == reader) || (mlsBarcodeSim_Start(sim))
+			|| (mlsBarcodeReader_Open_r(reader, (char *) mlsBarcodeSim_GetPath(sim))) )
+	{
+		CHECK(! "second scanner opened");
+		mlsBarcodeReader_Destroy(reader);
+		mlsBarcodeSim_Destroy(sim);
+		return;
+	}
+
+	mlsBarcodeReader_SetAutoReconnect(reader, TRUE);
+	CHECK(EXIT_SUCCESS == mlsBarcodeReader_StartThread(reader, NULL, NULL));
+
+	mlsBarcodeSim_Destroy(sim);
+	for (int i = 0; (i < READ_TIMEOUT_MSEC) && (mlsBarcodeReader_IsConnected(reader)); i++)
+	{
+		usleep(1000);
+	}
+	CHECK(! mlsBarcodeReader_IsConnected(reader));
+
+	mlsBarcodeReader_Destroy(reader);
+	CHECK(threads == CountThreads());
+}
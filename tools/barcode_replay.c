@@ -0,0 +1,273 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+// Replays a capture file written by mlsBarcodeReader_SetCapture(): scanner bytes are fed to a
+// reader without device, at recorded timing or as fast as possible, or the records are dumped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mlsBarcodeInternal.h"
+
+typedef struct replayOptions
+{
+	double speed;					// recorded timing divided by speed, 0 = as fast as possible
+	unsigned int loops;
+	int64_t maxGapNs;				// longest pause in timed replay
+	int isDump;
+	int isQuiet;
+} replayOptions;
+
+static int64_t GetTimeNs(void);
+static void OnBarcode(mlsBarcodeReader *reader, const char *barcode, unsigned int length,
+		const struct timespec *timestamp, void *userData);
+static void Dump(const byte *map, size_t len);
+static int Replay(const byte *map, size_t len, const replayOptions *options);
+static void Usage(const char *name);
+
+int main(int argc, char *argv[])
+{
+	replayOptions options = { .speed = 0, .loops = 1, .maxGapNs = 1000000000LL };
+	struct stat st;
+	byte *map = NULL;
+	int fd = -1;
+	int opt = 0;
+	int ret = EXIT_SUCCESS;
+
+	while (-1 != (opt = getopt(argc, argv, "r:n:g:dqh")))
+	{
+		switch (opt)
+		{
+			case 'r': options.speed = strtod(optarg, NULL); break;
+			case 'n': options.loops = strtoul(optarg, NULL, 0); break;
+			case 'g': options.maxGapNs = strtoll(optarg, NULL, 0) * 1000000LL; break;
+			case 'd': options.isDump = TRUE; break;
+			case 'q': options.isQuiet = TRUE; break;
+			default:
+				Usage(argv[0]);
+				return (('h' == opt) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (optind + 1 != argc)
+	{
+		Usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+	if ( (0 > fd) || (0 > fstat(fd, &st)) )
+	{
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	if ( ((size_t) st.st_size < sizeof(mlsBarcodeCaptureHeader)) )
+	{
+		fprintf(stderr, "%s: not a capture file\n", argv[optind]);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+	{
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+	if (0 != memcmp(map, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)))
+	{
+		fprintf(stderr, "%s: not a capture file\n", argv[optind]);
+		ret = EXIT_FAILURE;
+		goto EXIT;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	if (options.isDump)
+	{
+		Dump(map, st.st_size);
+	}
+	else
+	{
+		ret = Replay(map, st.st_size, &options);
+	}
+
+EXIT:
+	munmap(map, st.st_size);
+	return ret;
+}
+
+static int64_t GetTimeNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void OnBarcode(mlsBarcodeReader *reader, const char *barcode, unsigned int length,
+		const struct timespec *timestamp, void *userData)
+{
+	printf("%.*s\n", (int) length, barcode);
+}
+
+/*!
+ * \brief Dump print every record: time from first record, direction, length and bytes
+ */
+static void Dump(const byte *map, size_t len)
+{
+	mlsBarcodeCaptureHeader header;
+	mlsBarcodeCaptureRecord record;
+	size_t offset = sizeof(header);
+	int64_t firstNs = -1;
+	int64_t timeNs = 0;
+
+	memcpy(&header, map, sizeof(header));
+	printf("# started %lld.%09lld (CLOCK_REALTIME)\n", (long long) (header.realTimeNs / 1000000000LL),
+			(long long) (header.realTimeNs % 1000000000LL));
+
+	while (len - offset >= sizeof(record))
+	{
+		memcpy(&record, &map[offset], sizeof(record));
+		if ( (0 == record.direction) || (len - offset - sizeof(record) < record.length) )
+		{
+			break;
+		}
+		offset += sizeof(record);
+
+		timeNs = (int64_t) record.sec * 1000000000LL + record.nsec;
+		if (0 > firstNs)
+		{
+			firstNs = timeNs;
+		}
+		printf("%12.6f %s %4u:", (double) (timeNs - firstNs) / 1e9,
+				(CAPTURE_RX == record.direction) ? "RX" : "TX", record.length);
+		for (unsigned int i = 0; i < record.length; i++)
+		{
+			printf(" %02x", map[offset + i]);
+		}
+		printf("\n");
+		offset += record.length;
+	}
+}
+
+/*!
+ * \brief Replay feed scanner bytes of every record to a reader without device; its ACKs
+ * go to /dev/null
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int Replay(const byte *map, size_t len, const replayOptions *options)
+{
+	mlsBarcodeReader *reader = mlsBarcodeReader_Create();
+	mlsBarcodeCaptureRecord record;
+	mlsBarcodeStats stats;
+	struct timespec until;
+	unsigned long barcodes = 0;
+	unsigned long long records = 0;
+	unsigned long long bytes = 0;
+	size_t offset = 0;
+	int64_t startNs = 0;
+	int64_t lastNs = 0;
+	int64_t timeNs = 0;
+	int64_t replayNs = 0;
+	int64_t gapNs = 0;
+
+	if (NULL == reader)
+	{
+		return EXIT_FAILURE;
+	}
+	reader->fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (options->isQuiet)
+	{
+		// Checksum errors of the capture are counted below instead
+		mlsBarcodeLog_SetLevel(MLS_LOG_NONE);
+	}
+	else
+	{
+		mlsBarcodeReader_SetCallback(reader, OnBarcode, NULL);
+	}
+
+	startNs = GetTimeNs();
+	for (unsigned int loop = 0; loop < options->loops; loop++)
+	{
+		offset = sizeof(mlsBarcodeCaptureHeader);
+		lastNs = -1;
+		replayNs = GetTimeNs();
+
+		while (len - offset >= sizeof(record))
+		{
+			memcpy(&record, &map[offset], sizeof(record));
+			if ( (0 == record.direction) || (len - offset - sizeof(record) < record.length) )
+			{
+				break;
+			}
+			offset += sizeof(record);
+
+			if (CAPTURE_RX == record.direction)
+			{
+				if (0 < options->speed)
+				{
+					// Pauses longer than maxGapNs, or across reboots, are shortened
+					timeNs = (int64_t) record.sec * 1000000000LL + record.nsec;
+					gapNs = (0 > lastNs) ? 0 : timeNs - lastNs;
+					if ( (0 > gapNs) || (gapNs > options->maxGapNs) )
+					{
+						gapNs = options->maxGapNs;
+					}
+					lastNs = timeNs;
+					replayNs += (int64_t) (gapNs / options->speed);
+					until.tv_sec = replayNs / 1000000000LL;
+					until.tv_nsec = replayNs % 1000000000LL;
+					while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL));
+				}
+
+				barcodes += mlsBarcodeReader_FeedInput(reader, &map[offset], record.length);
+				bytes += record.length;
+				records++;
+			}
+			offset += record.length;
+		}
+	}
+	startNs = GetTimeNs() - startNs;
+
+	mlsBarcodeReader_GetStats(reader, &stats);
+	fprintf(stderr, "%llu records, %llu bytes, %lu barcodes, %llu frames, %llu checksum errors, "
+			"%llu resync bytes in %.3f s: %.1f MB/s, %.0f frames/s\n",
+			records, bytes, barcodes, stats.framesRx, stats.checksumErrors, stats.resyncBytes,
+			(double) startNs / 1e9, (double) bytes * 1000.0 / startNs, (double) stats.framesRx * 1e9 / startNs);
+
+	close(reader->fd);
+	reader->fd = -1;
+	mlsBarcodeReader_Destroy(reader);
+
+	return EXIT_SUCCESS;
+}
+
+static void Usage(const char *name)
+{
+	printf("Usage: %s [options] capture-file\n"
+			"  -r speed   replay at recorded timing, speed times faster (default: as fast as possible)\n"
+			"  -n count   replay count times, for parser throughput (1)\n"
+			"  -g ms      longest pause in timed replay (1000)\n"
+			"  -q         do not print barcodes nor library log\n"
+			"  -d         dump records instead of replaying them\n", name);
+}
@@ -0,0 +1,521 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+// Scale test: N simulated scanners on ptys, all opened through the library.
+// Simulators run in a child process so CPU, fd and thread figures only
+// cover the library side. Each barcode carries its send time, which gives
+// end-to-end latency from simulator write to application callback.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "mlsBarcode.h"
+#include "mlsBarcodeSim.h"
+
+#define TRUE				1
+#define FALSE				0
+#define MAX_DEVICES			1024
+#define STAMP_LEN			16		// hex send time at start of every barcode
+#define MIN_PAYLOAD			STAMP_LEN
+#define MAX_PAYLOAD			1000
+
+typedef enum scaleMode {MODE_ENGINE, MODE_THREAD} scaleMode;
+
+typedef struct scaleConfig
+{
+	int deviceCounts[32];
+	int steps;
+	double rate;					// scans per second per device
+	unsigned int payload;
+	unsigned int seconds;
+	scaleMode mode;
+} scaleConfig;
+
+typedef struct scaleSamples
+{
+	uint32_t *latencyUs;
+	unsigned long capacity;
+	unsigned long count;			// may exceed capacity, extra samples are only counted
+} scaleSamples;
+
+static int64_t GetTimeNs(void);
+static void RaiseFdLimit(void);
+static int CountFds(void);
+static int CountThreads(void);
+static int ParseCounts(scaleConfig *config, char *list);
+static void RunSimulators(const scaleConfig *config, int devices, int pathFd, int stopFd);
+static void OnBarcode(mlsBarcodeReader *reader, const char *barcode, unsigned int length,
+		const struct timespec *timestamp, void *userData);
+static int CompareU32(const void *a, const void *b);
+static int RunStep(const scaleConfig *config, int devices);
+
+int main(int argc, char *argv[])
+{
+	scaleConfig config = { .rate = 2.0, .payload = 32, .seconds = 5, .mode = MODE_ENGINE };
+	char defaultCounts[] = "16,64,128,256";
+	char *counts = defaultCounts;
+	int opt = 0;
+
+	while (-1 != (opt = getopt(argc, argv, "d:r:l:t:Th")))
+	{
+		switch (opt)
+		{
+			case 'd': counts = optarg; break;
+			case 'r': config.rate = strtod(optarg, NULL); break;
+			case 'l': config.payload = strtoul(optarg, NULL, 0); break;
+			case 't': config.seconds = strtoul(optarg, NULL, 0); break;
+			case 'T': config.mode = MODE_THREAD; break;
+			default:
+				printf("Usage: %s [-d 16,64,128,256] [-r scans/s/device] [-l payload] [-t seconds] [-T]\n"
+						"  -T  one reader thread per scanner instead of one epoll engine\n", argv[0]);
+				return (('h' == opt) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	if ( (ParseCounts(&config, counts)) || (0 >= config.rate) || (0 == config.seconds) )
+	{
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+	if (MIN_PAYLOAD > config.payload)
+	{
+		config.payload = MIN_PAYLOAD;
+	}
+	if (MAX_PAYLOAD < config.payload)
+	{
+		config.payload = MAX_PAYLOAD;
+	}
+
+	RaiseFdLimit();
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("%s mode, %.1f scans/s/device, %u byte barcodes, %u s per step\n",
+			(MODE_ENGINE == config.mode) ? "engine" : "thread", config.rate, config.payload, config.seconds);
+	printf("%8s %10s %10s %9s %9s %9s %9s %11s %6s %8s\n", "devices", "sent/s", "recv/s", "p50 us",
+			"p99 us", "p99.9 us", "max us", "cpu us/scan", "fds", "threads");
+
+	for (int i = 0; i < config.steps; i++)
+	{
+		if (RunStep(&config, config.deviceCounts[i]))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static int64_t GetTimeNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*!
+ * \brief RaiseFdLimit every simulated scanner costs 3 descriptors in the child, 1-2 in the library
+ */
+static void RaiseFdLimit(void)
+{
+	struct rlimit limit;
+
+	if (0 == getrlimit(RLIMIT_NOFILE, &limit))
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+static int CountFds(void)
+{
+	DIR *dir = opendir("/proc/self/fd");
+	int count = 0;
+
+	if (NULL == dir)
+	{
+		return -1;
+	}
+	while (NULL != readdir(dir))
+	{
+		count++;
+	}
+	closedir(dir);
+
+	// ".", ".." and the descriptor of dir itself
+	return count - 3;
+}
+
+static int CountThreads(void)
+{
+	char line[128];
+	int threads = -1;
+	FILE *file = fopen("/proc/self/status", "r");
+
+	if (NULL == file)
+	{
+		return -1;
+	}
+	while (NULL != fgets(line, sizeof(line), file))
+	{
+		if (1 == sscanf(line, "Threads: %d", &threads))
+		{
+			break;
+		}
+	}
+	fclose(file);
+
+	return threads;
+}
+
+static int ParseCounts(scaleConfig *config, char *list)
+{
+	char *token = NULL;
+	char *save = NULL;
+	int count = 0;
+
+	for (token = strtok_r(list, ",", &save); NULL != token; token = strtok_r(NULL, ",", &save))
+	{
+		count = atoi(token);
+		if ( (0 >= count) || (MAX_DEVICES < count)
+				|| (sizeof(config->deviceCounts) / sizeof(*config->deviceCounts) <= config->steps) )
+		{
+			return EXIT_FAILURE;
+		}
+		config->deviceCounts[config->steps++] = count;
+	}
+
+	return (0 < config->steps) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!
+ * \brief RunSimulators child process: create scanners, report their paths, then scan
+ * round robin at the aggregate rate until a byte is received on stopFd
+ */
+static void RunSimulators(const scaleConfig *config, int devices, int pathFd, int stopFd)
+{
+	mlsBarcodeSim **sims = calloc(devices, sizeof(*sims));
+	char barcode[MAX_PAYLOAD + 1];
+	char path[256];
+	const int64_t periodNs = (int64_t) (1e9 / (config->rate * devices));
+	int64_t next = 0;
+	int64_t now = 0;
+	struct timespec wait;
+	unsigned long sent = 0;
+	fd_set readSet;
+	struct timeval noWait;
+	int len = 0;
+
+	for (int i = 0; i < devices; i++)
+	{
+		sims[i] = mlsBarcodeSim_Create();
+		if ( (NULL == sims[i]) || (mlsBarcodeSim_Start(sims[i])) )
+		{
+			_exit(EXIT_FAILURE);
+		}
+		mlsBarcodeSim_SetDecodeEvent(sims[i], FALSE);
+		len = snprintf(path, sizeof(path), "%s\n", mlsBarcodeSim_GetPath(sims[i]));
+		if (write(pathFd, path, len) != len)
+		{
+			_exit(EXIT_FAILURE);
+		}
+	}
+	close(pathFd);
+
+	memset(barcode, 'A', sizeof(barcode));
+
+	// Parent writes once all scanners are opened
+	FD_ZERO(&readSet);
+	FD_SET(stopFd, &readSet);
+	if ( (1 != select(stopFd + 1, &readSet, NULL, NULL, NULL)) || (1 != read(stopFd, path, 1)) )
+	{
+		_exit(EXIT_FAILURE);
+	}
+
+	next = GetTimeNs();
+	while (TRUE)
+	{
+		FD_ZERO(&readSet);
+		FD_SET(stopFd, &readSet);
+		noWait.tv_sec = 0;
+		noWait.tv_usec = 0;
+		if (0 != select(stopFd + 1, &readSet, NULL, NULL, &noWait))
+		{
+			break;
+		}
+
+		now = GetTimeNs();
+		if (now < next)
+		{
+			wait.tv_sec = (next - now) / 1000000000LL;
+			wait.tv_nsec = (next - now) % 1000000000LL;
+			nanosleep(&wait, NULL);
+			now = GetTimeNs();
+		}
+
+		// Send time in barcode, CLOCK_MONOTONIC is shared by both processes
+		snprintf(barcode, STAMP_LEN + 1, "%016llx", (unsigned long long) now);
+		barcode[STAMP_LEN] = 'A';
+		mlsBarcodeSim_Scan(sims[sent % devices], MLS_SYMBOLOGY_CODE128, barcode, config->payload);
+		sent++;
+		next += periodNs;
+	}
+
+	// Report number of barcodes sent
+	len = snprintf(path, sizeof(path), "%lu\n", sent);
+	if (write(stopFd, path, len) != len)
+	{
+		_exit(EXIT_FAILURE);
+	}
+
+	// Keep ptys open until parent closed all scanners
+	while (0 < read(stopFd, path, sizeof(path)));
+
+	for (int i = 0; i < devices; i++)
+	{
+		mlsBarcodeSim_Destroy(sims[i]);
+	}
+	free(sims);
+	_exit(EXIT_SUCCESS);
+}
+
+static void OnBarcode(mlsBarcodeReader *reader, const char *barcode, unsigned int length,
+		const struct timespec *timestamp, void *userData)
+{
+	scaleSamples *samples = userData;
+	char stamp[STAMP_LEN + 1];
+	unsigned long index = 0;
+	int64_t sentNs = 0;
+
+	if (STAMP_LEN > length)
+	{
+		return;
+	}
+
+	memcpy(stamp, barcode, STAMP_LEN);
+	stamp[STAMP_LEN] = '\0';
+	sentNs = (int64_t) strtoull(stamp, NULL, 16);
+
+	index = __atomic_fetch_add(&samples->count, 1, __ATOMIC_RELAXED);
+	if (index < samples->capacity)
+	{
+		samples->latencyUs[index] = (uint32_t) ((GetTimeNs() - sentNs) / 1000);
+	}
+}
+
+static int CompareU32(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *) a;
+	const uint32_t y = *(const uint32_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*!
+ * \brief RunStep measure one device count
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int RunStep(const scaleConfig *config, int devices)
+{
+	mlsBarcodeReader **readers = calloc(devices, sizeof(*readers));
+	mlsBarcodeEngine *engine = NULL;
+	scaleSamples samples;
+	char path[256];
+	char go = 1;
+	FILE *paths = NULL;
+	FILE *report = NULL;
+	int pathPipe[2];
+	int control[2];			// go/stop to child, sent count back
+	pid_t child = 0;
+	int opened = 0;
+	int fds = 0;
+	int threads = 0;
+	unsigned long sent = 0;
+	unsigned long count = 0;
+	struct rusage usageStart;
+	struct rusage usageEnd;
+	int64_t start = 0;
+	int64_t end = 0;
+	double cpuUs = 0;
+	int ret = EXIT_FAILURE;
+
+	samples.capacity = (unsigned long) (config->rate * devices * config->seconds * 2) + 1024;
+	samples.latencyUs = malloc(samples.capacity * sizeof(*samples.latencyUs));
+	samples.count = 0;
+
+	if ( (NULL == readers) || (NULL == samples.latencyUs) || (pipe(pathPipe))
+			|| (socketpair(AF_UNIX, SOCK_STREAM, 0, control)) )
+	{
+		perror(__func__);
+		goto EXIT;
+	}
+
+	child = fork();
+	if (0 > child)
+	{
+		perror("fork");
+		goto EXIT;
+	}
+	if (0 == child)
+	{
+		close(pathPipe[0]);
+		close(control[0]);
+		RunSimulators(config, devices, pathPipe[1], control[1]);
+	}
+	close(pathPipe[1]);
+	close(control[1]);
+
+	if (MODE_ENGINE == config->mode)
+	{
+		engine = mlsBarcodeEngine_Create();
+	}
+
+	// Open every scanner the child announces
+	paths = fdopen(pathPipe[0], "r");
+	while ( (opened < devices) && (NULL != paths) && (NULL != fgets(path, sizeof(path), paths)) )
+	{
+		path[strcspn(path, "\n")] = '\0';
+		readers[opened] = mlsBarcodeReader_Create();
+		if ( (NULL == readers[opened]) || (mlsBarcodeReader_Open_r(readers[opened], path)) )
+		{
+			fprintf(stderr, "%s: open failed\n", path);
+			goto STOP;
+		}
+		opened++;
+
+		if (MODE_ENGINE == config->mode)
+		{
+			mlsBarcodeReader_SetCallback(readers[opened - 1], OnBarcode, &samples);
+			if ( (NULL == engine) || (mlsBarcodeEngine_Add(engine, readers[opened - 1])) )
+			{
+				goto STOP;
+			}
+		}
+		else if (mlsBarcodeReader_StartThread(readers[opened - 1], OnBarcode, &samples))
+		{
+			goto STOP;
+		}
+	}
+	if (opened < devices)
+	{
+		goto STOP;
+	}
+
+	getrusage(RUSAGE_SELF, &usageStart);
+	start = GetTimeNs();
+	end = start + (int64_t) config->seconds * 1000000000LL;
+	if (1 != write(control[0], &go, 1))
+	{
+		goto STOP;
+	}
+
+	while (GetTimeNs() < end)
+	{
+		if (MODE_ENGINE == config->mode)
+		{
+			mlsBarcodeEngine_Run(engine, 100);
+		}
+		else
+		{
+			usleep(100000);
+		}
+	}
+
+	fds = CountFds();
+	threads = CountThreads();
+	ret = EXIT_SUCCESS;
+
+STOP:
+	// Stop sending, let barcodes already on the wire arrive
+	if (1 != write(control[0], &go, 1))
+	{
+		ret = EXIT_FAILURE;
+	}
+	end = GetTimeNs();
+	while ( (MODE_ENGINE == config->mode) && (NULL != engine) && (GetTimeNs() < end + 200000000LL) )
+	{
+		mlsBarcodeEngine_Run(engine, 50);
+	}
+	if (MODE_THREAD == config->mode)
+	{
+		usleep(200000);
+	}
+	getrusage(RUSAGE_SELF, &usageEnd);
+
+	for (int i = 0; i < opened; i++)
+	{
+		if (NULL != engine)
+		{
+			mlsBarcodeEngine_Remove(engine, readers[i]);
+		}
+		mlsBarcodeReader_Destroy(readers[i]);
+	}
+	mlsBarcodeEngine_Destroy(engine);
+
+	report = fdopen(control[0], "r");
+	if ( (NULL == report) || (1 != fscanf(report, "%lu", &sent)) )
+	{
+		sent = 0;
+	}
+	if (NULL != report)
+	{
+		fclose(report);
+	}
+	else
+	{
+		close(control[0]);
+	}
+	waitpid(child, NULL, 0);
+
+	if (EXIT_SUCCESS == ret)
+	{
+		count = (samples.count < samples.capacity) ? samples.count : samples.capacity;
+		qsort(samples.latencyUs, count, sizeof(*samples.latencyUs), CompareU32);
+		cpuUs = (usageEnd.ru_utime.tv_sec - usageStart.ru_utime.tv_sec) * 1e6
+				+ (usageEnd.ru_utime.tv_usec - usageStart.ru_utime.tv_usec)
+				+ (usageEnd.ru_stime.tv_sec - usageStart.ru_stime.tv_sec) * 1e6
+				+ (usageEnd.ru_stime.tv_usec - usageStart.ru_stime.tv_usec);
+
+		printf("%8d %10.1f %10.1f %9u %9u %9u %9u %11.1f %6d %8d\n", devices,
+				sent / (double) config->seconds, samples.count / (double) config->seconds,
+				count ? samples.latencyUs[count / 2] : 0,
+				count ? samples.latencyUs[(count * 99) / 100] : 0,
+				count ? samples.latencyUs[(count * 999) / 1000] : 0,
+				count ? samples.latencyUs[count - 1] : 0,
+				samples.count ? cpuUs / samples.count : 0, fds, threads);
+		fflush(stdout);
+	}
+
+	if (NULL != paths)
+	{
+		fclose(paths);
+	}
+
+EXIT:
+	free(samples.latencyUs);
+	free(readers);
+	return ret;
+}
@@ -0,0 +1,166 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+// Command line front end of mlsBarcodeSim: creates a pty scanner, prints its
+// path (or links it to -L path) and emits barcodes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "ssi.h"
+#include "mlsBarcodeSim.h"
+
+#define TRUE		1
+#define FALSE		0
+#define MAX_LEN		4000
+
+static volatile sig_atomic_t isRunning = TRUE;
+
+static void HandleSignal(int sig);
+static void Usage(const char *name);
+
+int main(int argc, char *argv[])
+{
+	mlsBarcodeSim *sim = NULL;
+	mlsBarcodeSimStats stats;
+	char barcode[MAX_LEN];
+	const char *link = NULL;
+	int scans = -1;
+	unsigned int intervalMs = 1000;
+	unsigned int length = 12;
+	unsigned int symbology = 0x1C;
+	unsigned int delayMs = 0;
+	unsigned int nakCount = 0;
+	unsigned int nakCause = NAK_RESEND;
+	unsigned int badChecksum = 0;
+	unsigned int duplicates = 0;
+	int isDecodeEvent = TRUE;
+	int opt = 0;
+	int ret = EXIT_SUCCESS;
+
+	while (-1 != (opt = getopt(argc, argv, "n:i:l:s:d:k:K:c:u:L:eh")))
+	{
+		switch (opt)
+		{
+			case 'n': scans = atoi(optarg); break;
+			case 'i': intervalMs = strtoul(optarg, NULL, 0); break;
+			case 'l': length = strtoul(optarg, NULL, 0); break;
+			case 's': symbology = strtoul(optarg, NULL, 0); break;
+			case 'd': delayMs = strtoul(optarg, NULL, 0); break;
+			case 'k': nakCount = strtoul(optarg, NULL, 0); break;
+			case 'K': nakCause = strtoul(optarg, NULL, 0); break;
+			case 'c': badChecksum = strtoul(optarg, NULL, 0); break;
+			case 'u': duplicates = strtoul(optarg, NULL, 0); break;
+			case 'L': link = optarg; break;
+			case 'e': isDecodeEvent = FALSE; break;
+			default:
+				Usage(argv[0]);
+				return (('h' == opt) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	if (MAX_LEN < length)
+	{
+		length = MAX_LEN;
+	}
+	for (unsigned int i = 0; i < length; i++)
+	{
+		barcode[i] = 'A' + (i % 26);
+	}
+
+	sim = mlsBarcodeSim_Create();
+	if ( (NULL == sim) || (mlsBarcodeSim_Start(sim)) )
+	{
+		ret = EXIT_FAILURE;
+		goto EXIT;
+	}
+
+	mlsBarcodeSim_SetDecodeEvent(sim, isDecodeEvent);
+	mlsBarcodeSim_SetDelay(sim, delayMs);
+	mlsBarcodeSim_InjectNAK(sim, nakCount, nakCause);
+
+	if (NULL != link)
+	{
+		unlink(link);
+		if (symlink(mlsBarcodeSim_GetPath(sim), link))
+		{
+			perror(link);
+			ret = EXIT_FAILURE;
+			goto EXIT;
+		}
+	}
+	printf("%s\n", mlsBarcodeSim_GetPath(sim));
+	fflush(stdout);
+
+	signal(SIGINT, HandleSignal);
+	signal(SIGTERM, HandleSignal);
+
+	// Corrupt frames only once the host had time to configure the scanner
+	usleep(intervalMs * 1000);
+	mlsBarcodeSim_InjectChecksumError(sim, badChecksum);
+	mlsBarcodeSim_InjectDuplicate(sim, duplicates);
+	for (int n = 0; (isRunning) && ( (0 > scans) || (n < scans) ); n++)
+	{
+		if (mlsBarcodeSim_Scan(sim, symbology, barcode, length))
+		{
+			ret = EXIT_FAILURE;
+			break;
+		}
+		usleep(intervalMs * 1000);
+	}
+
+	// Keep answering the host until stopped
+	while (isRunning)
+	{
+		pause();
+	}
+
+	mlsBarcodeSim_GetStats(sim, &stats);
+	fprintf(stderr, "rx %llu tx %llu ack %llu nak %llu checksum errors %llu scans %llu retrans rx %llu tx %llu\n",
+			stats.framesRx, stats.framesTx, stats.acksRx, stats.naksRx, stats.checksumErrors, stats.scans,
+			stats.retransRx, stats.retransTx);
+
+EXIT:
+	if (NULL != link)
+	{
+		unlink(link);
+	}
+	mlsBarcodeSim_Destroy(sim);
+	return ret;
+}
+
+static void HandleSignal(int sig)
+{
+	(void) sig;
+	isRunning = FALSE;
+}
+
+static void Usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+			"  -n count   number of barcodes, default endless\n"
+			"  -i ms      interval between barcodes (1000)\n"
+			"  -l len     barcode length, longer than one packet uses continuation (12)\n"
+			"  -s type    symbology id (0x1C)\n"
+			"  -d ms      delay before every frame sent to host (0)\n"
+			"  -k count   NAK next count host commands\n"
+			"  -K cause   NAK cause (1: resend)\n"
+			"  -c count   corrupt checksum of count frames after first interval\n"
+			"  -u count   send count frames twice after first interval, as if host ACK was lost\n"
+			"  -L path    symlink to the pty slave\n"
+			"  -e         no decode event before decode data\n", name);
+}
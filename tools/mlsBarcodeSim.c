@@ -0,0 +1,884 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include "ssi.h"
+#include "ssiCodec.h"
+#include "mlsBarcodeSim.h"
+
+#define TRUE					1
+#define FALSE					0
+
+#define SIM_DECODE_EVENT		0x01	// SSI_EVENT code: barcode decoded
+#define SIM_DEC_CHUNK			(UINT8_MAX - SSI_HEADER_LEN - 1)	// data bytes per DEC_DATA packet
+#define SIM_MAX_BARCODE			4000
+#define SIM_ACK_TIMEOUT_MSEC	200		// wait for host ACK before next package
+#define SIM_BATCH_FRAMES		16		// host frames validated per ssiCodec_Split() call
+
+struct mlsBarcodeSim
+{
+	int master;
+	int slave;							// kept open so master does not see hang up between host opens
+	char path[PATH_MAX];
+
+	pthread_t thread;
+	int stopFd;
+	int isRunning;
+
+	pthread_mutex_t lock;				// serializes frames written by thread and mlsBarcodeSim_Scan()
+	pthread_cond_t ackCond;				// signaled on every host ACK
+	int isDecodeEvent;
+	unsigned int delayMs;
+	unsigned int nakCount;
+	unsigned char nakCause;
+	unsigned int badChecksumCount;
+	unsigned int duplicateCount;
+	unsigned int lostReplyCount;
+	int isScanEnabled;
+	unsigned char params[PARAM_NUMBER_MAX + 1];
+	mlsBarcodeSimStats stats;
+
+	// Decoded on every START_SESSION, like a host triggered scanner with a code in front of it
+	byte sessionBarcode[SIM_MAX_BARCODE];
+	unsigned int sessionLen;
+	unsigned char sessionSymbology;
+
+	byte rxBuff[2 * MAX_PKG_LEN];
+	int rxLen;
+
+	byte lastTx[MAX_PKG_LEN];			// last package needing ACK, resent on host NAK RESEND
+	uint32_t lastRxKey;					// opcode and checksum of last host command, see HandleFrame()
+};
+
+static void *SimThread(void *arg);
+static void ServiceInput(mlsBarcodeSim *sim);
+static void HandleFrame(mlsBarcodeSim *sim, const byte *pkg);
+static void ReplyParams(mlsBarcodeSim *sim, const byte *data, int len);
+static void StoreParams(mlsBarcodeSim *sim, const byte *data, int len);
+static int WriteFrame(mlsBarcodeSim *sim, byte opcode, byte status, const byte *data, int len);
+static int SendPkg(mlsBarcodeSim *sim, byte *pkg);
+static void ResendLast(mlsBarcodeSim *sim);
+static int WriteAndWait(mlsBarcodeSim *sim, byte opcode, byte status, const byte *data, int len);
+
+/*!
+ * \brief mlsBarcodeSim_Create open a pty in raw mode, answering thread is not started yet
+ * \return simulator context, NULL on failure
+ */
+mlsBarcodeSim *mlsBarcodeSim_Create(void)
+{
+	mlsBarcodeSim *sim = calloc(1, sizeof(mlsBarcodeSim));
+	struct termios options;
+	pthread_condattr_t condAttr;
+
+	if (NULL == sim)
+	{
+		return NULL;
+	}
+
+	sim->slave = -1;
+	sim->stopFd = -1;
+	sim->isDecodeEvent = TRUE;
+	sim->isScanEnabled = TRUE;
+	pthread_mutex_init(&sim->lock, NULL);
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sim->ackCond, &condAttr);
+	pthread_condattr_destroy(&condAttr);
+
+	sim->master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if ( (0 > sim->master) || (grantpt(sim->master)) || (unlockpt(sim->master))
+			|| (ptsname_r(sim->master, sim->path, sizeof(sim->path))) )
+	{
+		perror(__func__);
+		goto FAIL;
+	}
+
+	sim->slave = open(sim->path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (0 > sim->slave)
+	{
+		perror(sim->path);
+		goto FAIL;
+	}
+
+	// Binary link: no echo, no line discipline processing
+	tcgetattr(sim->slave, &options);
+	cfmakeraw(&options);
+	tcsetattr(sim->slave, TCSANOW, &options);
+
+	return sim;
+
+FAIL:
+	mlsBarcodeSim_Destroy(sim);
+	return NULL;
+}
+
+/*!
+ * \brief mlsBarcodeSim_Destroy stop simulator and close the pty
+ */
+void mlsBarcodeSim_Destroy(mlsBarcodeSim *sim)
+{
+	if (NULL == sim)
+	{
+		return;
+	}
+
+	mlsBarcodeSim_Stop(sim);
+
+	if (0 <= sim->slave)
+	{
+		close(sim->slave);
+	}
+	if (0 <= sim->master)
+	{
+		close(sim->master);
+	}
+	pthread_cond_destroy(&sim->ackCond);
+	pthread_mutex_destroy(&sim->lock);
+	free(sim);
+}
+
+/*!
+ * \brief mlsBarcodeSim_GetPath slave device path to give to mlsBarcodeReader_Open_r()
+ */
+const char *mlsBarcodeSim_GetPath(mlsBarcodeSim *sim)
+{
+	assert(sim != NULL);
+
+	return sim->path;
+}
+
+/*!
+ * \brief mlsBarcodeSim_Start start the thread answering host commands
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeSim_Start(mlsBarcodeSim *sim)
+{
+	int ret = 0;
+
+	assert(sim != NULL);
+
+	if (sim->isRunning)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	sim->stopFd = eventfd(0, EFD_CLOEXEC);
+	if (0 > sim->stopFd)
+	{
+		perror(__func__);
+		return EXIT_FAILURE;
+	}
+
+	ret = pthread_create(&sim->thread, NULL, SimThread, sim);
+	if (ret)
+	{
+		errno = ret;
+		perror(__func__);
+		close(sim->stopFd);
+		sim->stopFd = -1;
+		return EXIT_FAILURE;
+	}
+
+	sim->isRunning = TRUE;
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeSim_Stop stop the answering thread and wait for it to exit
+ */
+void mlsBarcodeSim_Stop(mlsBarcodeSim *sim)
+{
+	const uint64_t wakeUp = 1;
+
+	assert(sim != NULL);
+
+	if (! sim->isRunning)
+	{
+		return;
+	}
+
+	if (write(sim->stopFd, &wakeUp, sizeof(wakeUp)) != sizeof(wakeUp))
+	{
+		perror(__func__);
+	}
+
+	pthread_join(sim->thread, NULL);
+	close(sim->stopFd);
+	sim->stopFd = -1;
+	sim->isRunning = FALSE;
+}
+
+/*!
+ * \brief mlsBarcodeSim_Scan emit one barcode: optional decode event, then DEC_DATA
+ * packets, split into continuation packets when data does not fit in one
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeSim_Scan(mlsBarcodeSim *sim, unsigned char symbology, const void *data, unsigned int length)
+{
+	byte chunk[SIM_DEC_CHUNK + 1];
+	const byte *barcode = data;
+	unsigned int offset = 0;
+	unsigned int len = 0;
+	byte status = SSI_DEFAULT_STATUS;
+	byte event = SIM_DECODE_EVENT;
+
+	assert(sim != NULL);
+	assert( (data != NULL) || (0 == length) );
+
+	if ( (sim->isDecodeEvent) && (WriteAndWait(sim, SSI_EVENT, SSI_DEFAULT_STATUS, &event, 1)) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	do
+	{
+		len = length - offset;
+		if (SIM_DEC_CHUNK < len)
+		{
+			len = SIM_DEC_CHUNK;
+		}
+		status = (offset + len < length) ? STAT_CONTINUATION : SSI_DEFAULT_STATUS;
+
+		// Every packet carries the barcode type
+		chunk[0] = symbology;
+		memcpy(&chunk[1], &barcode[offset], len);
+		if (WriteAndWait(sim, SSI_DEC_DATA, status, chunk, len + 1))
+		{
+			return EXIT_FAILURE;
+		}
+		offset += len;
+	} while (offset < length);
+
+	pthread_mutex_lock(&sim->lock);
+	sim->stats.scans++;
+	pthread_mutex_unlock(&sim->lock);
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeSim_SetSessionBarcode emit this barcode after ACK of every host START_SESSION,
+ * length 0 disables
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: barcode too long
+ */
+char mlsBarcodeSim_SetSessionBarcode(mlsBarcodeSim *sim, unsigned char symbology, const void *data,
+		unsigned int length)
+{
+	assert(sim != NULL);
+
+	if (SIM_MAX_BARCODE < length)
+	{
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&sim->lock);
+	if (0 < length)
+	{
+		memcpy(sim->sessionBarcode, data, length);
+	}
+	sim->sessionLen = length;
+	sim->sessionSymbology = symbology;
+	pthread_mutex_unlock(&sim->lock);
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief mlsBarcodeSim_SetDecodeEvent send SSI_EVENT before decode data (default on)
+ */
+void mlsBarcodeSim_SetDecodeEvent(mlsBarcodeSim *sim, int isEnabled)
+{
+	assert(sim != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	sim->isDecodeEvent = isEnabled;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief mlsBarcodeSim_SetDelay wait delayMs before every frame written to the host
+ */
+void mlsBarcodeSim_SetDelay(mlsBarcodeSim *sim, unsigned int delayMs)
+{
+	assert(sim != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	sim->delayMs = delayMs;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief mlsBarcodeSim_InjectNAK answer the next count host commands with CMD_NAK cause
+ */
+void mlsBarcodeSim_InjectNAK(mlsBarcodeSim *sim, unsigned int count, unsigned char cause)
+{
+	assert(sim != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	sim->nakCount = count;
+	sim->nakCause = cause;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief mlsBarcodeSim_InjectChecksumError corrupt checksum of the next count frames written to the host
+ */
+void mlsBarcodeSim_InjectChecksumError(mlsBarcodeSim *sim, unsigned int count)
+{
+	assert(sim != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	sim->badChecksumCount = count;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief mlsBarcodeSim_InjectDuplicate write the next count packages needing ACK twice, the second
+ * time with retransmit bit, as if the host ACK was lost
+ */
+void mlsBarcodeSim_InjectDuplicate(mlsBarcodeSim *sim, unsigned int count)
+{
+	assert(sim != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	sim->duplicateCount = count;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief mlsBarcodeSim_InjectLostReply execute the next count host commands but do not answer
+ * them, as if their ACK was lost on the line
+ */
+void mlsBarcodeSim_InjectLostReply(mlsBarcodeSim *sim, unsigned int count)
+{
+	assert(sim != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	sim->lostReplyCount = count;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief mlsBarcodeSim_IsScanEnabled scanning state left by host SCAN_ENABLE/SCAN_DISABLE
+ */
+int mlsBarcodeSim_IsScanEnabled(mlsBarcodeSim *sim)
+{
+	int isEnabled = FALSE;
+
+	assert(sim != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	isEnabled = sim->isScanEnabled;
+	pthread_mutex_unlock(&sim->lock);
+
+	return isEnabled;
+}
+
+/*!
+ * \brief mlsBarcodeSim_GetParam value of a parameter set by host PARAM_SEND, 0 if never set
+ */
+unsigned char mlsBarcodeSim_GetParam(mlsBarcodeSim *sim, unsigned short number)
+{
+	unsigned char value = 0;
+
+	assert(sim != NULL);
+
+	if (PARAM_NUMBER_MAX >= number)
+	{
+		pthread_mutex_lock(&sim->lock);
+		value = sim->params[number];
+		pthread_mutex_unlock(&sim->lock);
+	}
+
+	return value;
+}
+
+/*!
+ * \brief mlsBarcodeSim_GetStats copy simulator counters
+ */
+void mlsBarcodeSim_GetStats(mlsBarcodeSim *sim, mlsBarcodeSimStats *stats)
+{
+	assert(sim != NULL);
+	assert(stats != NULL);
+
+	pthread_mutex_lock(&sim->lock);
+	*stats = sim->stats;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief SimThread wait for host frames or stop request
+ */
+static void *SimThread(void *arg)
+{
+	mlsBarcodeSim *sim = arg;
+	struct pollfd pfd[2];
+	int ret = 0;
+
+	pfd[0].fd = sim->master;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = sim->stopFd;
+	pfd[1].events = POLLIN;
+
+	while (TRUE)
+	{
+		ret = poll(pfd, 2, -1);
+		if (0 > ret)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			perror(__func__);
+			break;
+		}
+
+		if (pfd[1].revents)
+		{
+			break;
+		}
+
+		if (pfd[0].revents & POLLIN)
+		{
+			ServiceInput(sim);
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief ServiceInput read available host bytes and handle every complete frame
+ */
+static void ServiceInput(mlsBarcodeSim *sim)
+{
+	ssiFrame frames[SIM_BATCH_FRAMES];
+	ssize_t len = 0;
+	int count = 0;
+	int consumed = 0;
+	int offset = 0;
+
+	len = read(sim->master, &sim->rxBuff[sim->rxLen], sizeof(sim->rxBuff) - sim->rxLen);
+	if (0 >= len)
+	{
+		return;
+	}
+	sim->rxLen += len;
+
+	do
+	{
+		count = ssiCodec_Split(&sim->rxBuff[offset], sim->rxLen - offset, frames, SIM_BATCH_FRAMES, &consumed);
+		for (int i = 0; i < count; i++)
+		{
+			if (! frames[i].isChecksumOK)
+			{
+				byte cause = NAK_RESEND;
+
+				pthread_mutex_lock(&sim->lock);
+				sim->stats.checksumErrors++;
+				pthread_mutex_unlock(&sim->lock);
+				WriteFrame(sim, SSI_CMD_NAK, SSI_DEFAULT_STATUS, &cause, 1);
+			}
+			else
+			{
+				HandleFrame(sim, frames[i].pkg);
+			}
+		}
+		offset += consumed;
+	} while (SIM_BATCH_FRAMES == count);
+
+	sim->rxLen -= offset;
+	memmove(sim->rxBuff, &sim->rxBuff[offset], sim->rxLen);
+}
+
+/*!
+ * \brief HandleFrame answer one host frame as the decoder would
+ */
+static void HandleFrame(mlsBarcodeSim *sim, const byte *pkg)
+{
+	const byte opcode = pkg[INDEX_OPCODE];
+	const byte *data = &pkg[SSI_HEADER_LEN];
+	const int dataLen = PKG_LEN(pkg) - SSI_HEADER_LEN;
+	const int isRetrans = pkg[INDEX_STAT] & STAT_RETRANS;
+	uint16_t checksum = SSI_FRAME_CKSUM(pkg);
+	uint32_t key = 0;
+	byte cause = 0;
+	int isNAK = FALSE;
+	int isDuplicate = FALSE;
+	int isReplyLost = FALSE;
+	unsigned int sessionLen = 0;
+
+	// Checksum of first transmission identifies the command
+	if (isRetrans)
+	{
+		checksum += STAT_RETRANS;
+	}
+	key = ( (uint32_t) opcode << 16 ) | checksum;
+
+	pthread_mutex_lock(&sim->lock);
+	sim->stats.framesRx++;
+	if (isRetrans)
+	{
+		sim->stats.retransRx++;
+	}
+	switch (opcode)
+	{
+		case SSI_CMD_ACK:
+			sim->stats.acksRx++;
+			pthread_cond_broadcast(&sim->ackCond);
+			break;
+		case SSI_CMD_NAK:
+			sim->stats.naksRx++;
+			break;
+		default:
+			if (sim->nakCount)
+			{
+				sim->nakCount--;
+				cause = sim->nakCause;
+				isNAK = TRUE;
+			}
+			else
+			{
+				// Resend of the command just executed: ACK was lost, do not execute again
+				isDuplicate = (isRetrans) && (key == sim->lastRxKey);
+				sim->lastRxKey = key;
+			}
+			if ( (! isNAK) && (! isDuplicate) )
+			{
+				sim->stats.commandsRun++;
+				if (SSI_SCAN_ENABLE == opcode)
+				{
+					sim->isScanEnabled = TRUE;
+				}
+				else if (SSI_SCAN_DISABLE == opcode)
+				{
+					sim->isScanEnabled = FALSE;
+				}
+				if (sim->lostReplyCount)
+				{
+					sim->lostReplyCount--;
+					isReplyLost = TRUE;
+				}
+			}
+			break;
+	}
+	pthread_mutex_unlock(&sim->lock);
+
+	if (SSI_CMD_ACK == opcode)
+	{
+		return;
+	}
+
+	if (SSI_CMD_NAK == opcode)
+	{
+		if ( (PKG_LEN(pkg) > INDEX_CAUSE) && (NAK_RESEND == pkg[INDEX_CAUSE]) )
+		{
+			ResendLast(sim);
+		}
+		return;
+	}
+
+	if (isNAK)
+	{
+		WriteFrame(sim, SSI_CMD_NAK, SSI_DEFAULT_STATUS, &cause, 1);
+		return;
+	}
+
+	if (isDuplicate)
+	{
+		WriteFrame(sim, SSI_CMD_ACK, SSI_DEFAULT_STATUS, NULL, 0);
+		return;
+	}
+
+	switch (opcode)
+	{
+		case SSI_PARAM_REQUEST:
+			// Answered with PARAM_SEND instead of ACK
+			if (! isReplyLost)
+			{
+				ReplyParams(sim, data, dataLen);
+			}
+			return;
+		case SSI_PARAM_SEND:
+			// First data byte is the beep code
+			if (0 < dataLen)
+			{
+				StoreParams(sim, &data[1], dataLen - 1);
+			}
+			break;
+		default:
+			break;
+	}
+
+	if (! isReplyLost)
+	{
+		WriteFrame(sim, SSI_CMD_ACK, SSI_DEFAULT_STATUS, NULL, 0);
+	}
+
+	if (SSI_START_SESSION == opcode)
+	{
+		pthread_mutex_lock(&sim->lock);
+		sessionLen = sim->sessionLen;
+		pthread_mutex_unlock(&sim->lock);
+
+		// Barcode content must not be changed while host runs sessions
+		if (sessionLen)
+		{
+			mlsBarcodeSim_Scan(sim, sim->sessionSymbology, sim->sessionBarcode, sessionLen);
+		}
+	}
+}
+
+/*!
+ * \brief ReplyParams answer PARAM_REQUEST with current values of the requested parameters
+ */
+static void ReplyParams(mlsBarcodeSim *sim, const byte *data, int len)
+{
+	byte reply[UINT8_MAX];
+	int replyLen = 0;
+	unsigned short number = 0;
+	int i = 0;
+
+	reply[replyLen++] = PARAM_BEEP_NONE;
+
+	pthread_mutex_lock(&sim->lock);
+	while ( (i < len) && (replyLen + 3 <= UINT8_MAX - SSI_HEADER_LEN) )
+	{
+		number = data[i];
+		reply[replyLen++] = data[i++];
+		if ( (PARAM_INDEX_F0 <= number) && (PARAM_INDEX_F2 >= number) && (i < len) )
+		{
+			number = PARAM_EXT(number, data[i]);
+			reply[replyLen++] = data[i++];
+		}
+		reply[replyLen++] = sim->params[number];
+	}
+	pthread_mutex_unlock(&sim->lock);
+
+	WriteFrame(sim, SSI_PARAM_SEND, SSI_DEFAULT_STATUS, reply, replyLen);
+}
+
+/*!
+ * \brief StoreParams keep number/value pairs of a host PARAM_SEND
+ */
+static void StoreParams(mlsBarcodeSim *sim, const byte *data, int len)
+{
+	unsigned short number = 0;
+	int i = 0;
+
+	pthread_mutex_lock(&sim->lock);
+	while (i + 1 < len)
+	{
+		number = data[i++];
+		if ( (PARAM_INDEX_F0 <= number) && (PARAM_INDEX_F2 >= number) )
+		{
+			number = PARAM_EXT(number, data[i]);
+			i++;
+			if (i >= len)
+			{
+				break;
+			}
+		}
+		sim->params[number] = data[i++];
+	}
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief WriteFrame format one device package and write it to the host, applying injected faults
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int WriteFrame(mlsBarcodeSim *sim, byte opcode, byte status, const byte *data, int len)
+{
+	byte pkg[MAX_PKG_LEN];
+	const int pkgLen = SSI_HEADER_LEN + len;
+	int isDuplicate = FALSE;
+	int ret = EXIT_SUCCESS;
+
+	assert(pkgLen <= UINT8_MAX);
+
+	pkg[INDEX_LEN] = pkgLen;
+	pkg[INDEX_OPCODE] = opcode;
+	pkg[INDEX_SRC] = 0;
+	pkg[INDEX_STAT] = status;
+	if (0 < len)
+	{
+		memcpy(&pkg[SSI_HEADER_LEN], data, len);
+	}
+
+	pthread_mutex_lock(&sim->lock);
+	ret = SendPkg(sim, pkg);
+
+	// Packages needing ACK can be asked for again
+	if ( (SSI_CMD_ACK != opcode) && (SSI_CMD_NAK != opcode) )
+	{
+		memcpy(sim->lastTx, pkg, pkgLen);
+		if (sim->duplicateCount)
+		{
+			sim->duplicateCount--;
+			isDuplicate = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&sim->lock);
+
+	if ( (EXIT_SUCCESS == ret) && (isDuplicate) )
+	{
+		ResendLast(sim);
+	}
+
+	return ret;
+}
+
+/*!
+ * \brief WriteAndWait write a package needing ACK and, like the decoder, hold the next one
+ * until the host ACKs it or SIM_ACK_TIMEOUT_MSEC passes. Host NAK RESEND is answered by
+ * the thread meanwhile. Packages written by the thread itself (session barcode) are not paced.
+ * \return
+ * - EXIT_SUCCESS: Success, ACKed or not
+ * - EXIT_FAILURE: write failed
+ */
+static int WriteAndWait(mlsBarcodeSim *sim, byte opcode, byte status, const byte *data, int len)
+{
+	unsigned long long acks = 0;
+	struct timespec deadline;
+	int ret = 0;
+
+	pthread_mutex_lock(&sim->lock);
+	acks = sim->stats.acksRx;
+	pthread_mutex_unlock(&sim->lock);
+
+	if (WriteFrame(sim, opcode, status, data, len))
+	{
+		return EXIT_FAILURE;
+	}
+
+	if ( (sim->isRunning) && (pthread_equal(pthread_self(), sim->thread)) )
+	{
+		return EXIT_SUCCESS;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += SIM_ACK_TIMEOUT_MSEC / 1000;
+	deadline.tv_nsec += (SIM_ACK_TIMEOUT_MSEC % 1000) * 1000000L;
+	if (1000000000L <= deadline.tv_nsec)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&sim->lock);
+	while ( (acks == sim->stats.acksRx) && (ETIMEDOUT != ret) )
+	{
+		ret = pthread_cond_timedwait(&sim->ackCond, &sim->lock, &deadline);
+	}
+	pthread_mutex_unlock(&sim->lock);
+
+	return EXIT_SUCCESS;
+}
+
+/*!
+ * \brief ResendLast write last package needing ACK again with retransmit bit
+ */
+static void ResendLast(mlsBarcodeSim *sim)
+{
+	byte pkg[MAX_PKG_LEN];
+
+	pthread_mutex_lock(&sim->lock);
+	if (PKG_LEN(sim->lastTx))
+	{
+		memcpy(pkg, sim->lastTx, PKG_LEN(sim->lastTx));
+		pkg[INDEX_STAT] |= STAT_RETRANS;
+		if (EXIT_SUCCESS == SendPkg(sim, pkg))
+		{
+			sim->stats.retransTx++;
+		}
+	}
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*!
+ * \brief SendPkg add checksum to package and write it to the host, applying injected faults.
+ * Caller holds lock.
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+static int SendPkg(mlsBarcodeSim *sim, byte *pkg)
+{
+	const int pkgLen = PKG_LEN(pkg);
+	unsigned short checksum = ssiCodec_Checksum(pkg, pkgLen);
+	struct timespec delay;
+	int written = 0;
+	ssize_t ret = 0;
+
+	if (sim->delayMs)
+	{
+		delay.tv_sec = sim->delayMs / 1000;
+		delay.tv_nsec = (sim->delayMs % 1000) * 1000000L;
+		while (nanosleep(&delay, &delay) && (EINTR == errno));
+	}
+
+	if (sim->badChecksumCount)
+	{
+		sim->badChecksumCount--;
+		checksum ^= 1;
+	}
+	pkg[pkgLen] = checksum >> 8;
+	pkg[pkgLen + 1] = checksum & 0xFF;
+
+	// pty may accept less than a frame when host is slow to read
+	while (written < pkgLen + SSI_CKSUM_LEN)
+	{
+		ret = write(sim->master, &pkg[written], pkgLen + SSI_CKSUM_LEN - written);
+		if (0 > ret)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			perror(__func__);
+			break;
+		}
+		written += ret;
+	}
+	if (written == pkgLen + SSI_CKSUM_LEN)
+	{
+		sim->stats.framesTx++;
+	}
+
+	return (written == pkgLen + SSI_CKSUM_LEN) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
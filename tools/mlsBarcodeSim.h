@@ -0,0 +1,143 @@
+/*******************************************************************************
+     (C) Copyright 2009 Styl Solutions Co., Ltd. , All rights reserved *
+     *
+     This source code and any compilation or derivative thereof is the sole *
+     property of Styl Solutions Co., Ltd. and is provided pursuant to a *
+     Software License Agreement. This code is the proprietary information *
+     of Styl Solutions Co., Ltd and is confidential in nature. Its use and *
+     dissemination by any party other than Styl Solutions Co., Ltd is *
+     strictly limited by the confidential information provisions of the *
+     Agreement referenced above. *
+     ******************************************************************************/
+
+
+#ifndef MLSBARCODESIM_H
+#define MLSBARCODESIM_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*!
+ * \brief mlsBarcodeSim software SSI scanner on a pseudo-terminal.
+ * The simulator owns the master side of a pty and answers as the decoder would,
+ * so mlsBarcodeReader_Open_r() can be pointed at mlsBarcodeSim_GetPath() for
+ * tests and benchmarks without hardware.
+ */
+typedef struct mlsBarcodeSim mlsBarcodeSim;
+
+/*!
+ * \brief mlsBarcodeSimStats frames seen by the simulator
+ */
+typedef struct mlsBarcodeSimStats
+{
+	unsigned long long framesRx;		// host frames with valid checksum
+	unsigned long long framesTx;		// frames written to the host
+	unsigned long long acksRx;			// CMD_ACK from host
+	unsigned long long naksRx;			// CMD_NAK from host
+	unsigned long long checksumErrors;	// host frames with bad checksum
+	unsigned long long scans;			// completed mlsBarcodeSim_Scan() calls
+	unsigned long long retransRx;		// host frames with retransmit bit
+	unsigned long long retransTx;		// frames written again after host NAK RESEND or injected duplicate
+	unsigned long long commandsRun;		// host commands executed, duplicates and NAKed ones excluded
+} mlsBarcodeSimStats;
+
+/*!
+ * \brief mlsBarcodeSim_Create open a pty in raw mode, answering thread is not started yet
+ * \return simulator context, NULL on failure
+ */
+mlsBarcodeSim *mlsBarcodeSim_Create(void);
+
+/*!
+ * \brief mlsBarcodeSim_Destroy stop simulator and close the pty
+ */
+void mlsBarcodeSim_Destroy(mlsBarcodeSim *sim);
+
+/*!
+ * \brief mlsBarcodeSim_GetPath slave device path to give to mlsBarcodeReader_Open_r()
+ */
+const char *mlsBarcodeSim_GetPath(mlsBarcodeSim *sim);
+
+/*!
+ * \brief mlsBarcodeSim_Start start the thread answering host commands
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeSim_Start(mlsBarcodeSim *sim);
+
+/*!
+ * \brief mlsBarcodeSim_Stop stop the answering thread and wait for it to exit
+ */
+void mlsBarcodeSim_Stop(mlsBarcodeSim *sim);
+
+/*!
+ * \brief mlsBarcodeSim_Scan emit one barcode: optional decode event, then DEC_DATA
+ * packets, split into continuation packets when data does not fit in one
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: Fail
+ */
+char mlsBarcodeSim_Scan(mlsBarcodeSim *sim, unsigned char symbology, const void *data, unsigned int length);
+
+/*!
+ * \brief mlsBarcodeSim_SetSessionBarcode emit this barcode after ACK of every host START_SESSION,
+ * length 0 disables
+ * \return
+ * - EXIT_SUCCESS: Success
+ * - EXIT_FAILURE: barcode too long
+ */
+char mlsBarcodeSim_SetSessionBarcode(mlsBarcodeSim *sim, unsigned char symbology, const void *data,
+		unsigned int length);
+
+/*!
+ * \brief mlsBarcodeSim_SetDecodeEvent send SSI_EVENT before decode data (default on)
+ */
+void mlsBarcodeSim_SetDecodeEvent(mlsBarcodeSim *sim, int isEnabled);
+
+/*!
+ * \brief mlsBarcodeSim_SetDelay wait delayMs before every frame written to the host
+ */
+void mlsBarcodeSim_SetDelay(mlsBarcodeSim *sim, unsigned int delayMs);
+
+/*!
+ * \brief mlsBarcodeSim_InjectNAK answer the next count host commands with CMD_NAK cause
+ */
+void mlsBarcodeSim_InjectNAK(mlsBarcodeSim *sim, unsigned int count, unsigned char cause);
+
+/*!
+ * \brief mlsBarcodeSim_InjectChecksumError corrupt checksum of the next count frames written to the host
+ */
+void mlsBarcodeSim_InjectChecksumError(mlsBarcodeSim *sim, unsigned int count);
+
+/*!
+ * \brief mlsBarcodeSim_InjectDuplicate write the next count packages needing ACK twice, the second
+ * time with retransmit bit, as if the host ACK was lost
+ */
+void mlsBarcodeSim_InjectDuplicate(mlsBarcodeSim *sim, unsigned int count);
+
+/*!
+ * \brief mlsBarcodeSim_InjectLostReply execute the next count host commands but do not answer
+ * them, as if their ACK was lost on the line
+ */
+void mlsBarcodeSim_InjectLostReply(mlsBarcodeSim *sim, unsigned int count);
+
+/*!
+ * \brief mlsBarcodeSim_IsScanEnabled scanning state left by host SCAN_ENABLE/SCAN_DISABLE (enabled at start)
+ */
+int mlsBarcodeSim_IsScanEnabled(mlsBarcodeSim *sim);
+
+/*!
+ * \brief mlsBarcodeSim_GetParam value of a parameter set by host PARAM_SEND, 0 if never set
+ */
+unsigned char mlsBarcodeSim_GetParam(mlsBarcodeSim *sim, unsigned short number);
+
+/*!
+ * \brief mlsBarcodeSim_GetStats copy simulator counters
+ */
+void mlsBarcodeSim_GetStats(mlsBarcodeSim *sim, mlsBarcodeSimStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // MLSBARCODESIM_H